@@ -105,8 +105,28 @@ void Application::ui_update()
     ImGui::SameLine();
     ImGui::Text("%s", glm::to_string(camera.get_camera_position()).c_str());
     if (ImGui::Button("Reload Scene", {100, 20})) { state.file_browser.Open(); }
+    if(scene_load != nullptr)
+    {
+        ImGui::Text("Loading %s", scene_load->path.c_str());
+        ImGui::ProgressBar(scene_load->progress.fraction, {-1.0f, 0.0f});
+        if (ImGui::Button("Cancel", {100, 20})) { cancel_scene_load(); }
+    }
 
     ImGui::Checkbox("Jitter camera", &state.current.jitter_camera);
+    ImGui::Checkbox("GPU culling", &state.current.gpu_culling);
+    // meshlets are only culled on the CPU path and only for meshes with a single visible instance,
+    // occlusion culling and the depth prepass only exist on the GPU one
+    if(state.current.gpu_culling) { ImGui::BeginDisabled(); }
+    ImGui::Checkbox("Meshlet cone culling", &state.current.meshlet_cone_culling);
+    ImGui::Checkbox("Static batching", &state.current.static_batching);
+    ImGui::Checkbox("Depth sort", &state.current.depth_sort);
+    if(state.current.gpu_culling) { ImGui::EndDisabled(); }
+    if(!state.current.gpu_culling) { ImGui::BeginDisabled(); }
+    ImGui::Checkbox("Occlusion culling", &state.current.occlusion_culling);
+    ImGui::Checkbox("Depth prepass", &state.current.depth_prepass);
+    if(!state.current.gpu_culling) { ImGui::EndDisabled(); }
+    ImGui::Checkbox("Select LODs", &state.current.lod_selection);
+    ImGui::Checkbox("Count overdraw", &state.current.count_overdraw);
 
     ImGui::Checkbox("Accumulate", &state.current.accumulate);
 
@@ -116,12 +136,60 @@ void Application::ui_update()
     ImGui::Checkbox("Reproject velocity", &state.current.reproject_velocity);
     if(!state.current.accumulate) { ImGui::EndDisabled(); }
 
-    if(!state.current.reproject_velocity) {ImGui::BeginDisabled(); }
+    ImGui::Checkbox("Velocity from depth", &state.current.depth_velocity);
+    if(!state.current.reproject_velocity || state.current.depth_velocity) {ImGui::BeginDisabled(); }
     ImGui::Checkbox("Reject velocity", &state.current.reject_velocity);
-    if(!state.current.reproject_velocity) {ImGui::EndDisabled(); }
+    if(!state.current.reproject_velocity || state.current.depth_velocity) {ImGui::EndDisabled(); }
+    ImGui::Checkbox("16x16 TAA tiles", &state.current.large_taa_tiles);
+    // every footprint with the TAA time last measured for it, with all other settings as they were then
+    ImGui::Text("TAA footprint");
+    const std::array<const char *, static_cast<usize>(TAAFootprint::COUNT)> footprint_names = {"3x3", "5-tap plus", "Separable 3x3"};
+    for(usize footprint = 0; footprint < footprint_names.size(); footprint++)
+    {
+        ImGui::SameLine();
+        f64 footprint_time = renderer.taa_footprint_time[footprint];
+        std::string label = std::string(footprint_names[footprint]) + 
+            (footprint_time > 0.0 ? " (" + std::to_string(static_cast<u64>(footprint_time)) + " ns)" : std::string(" (-)"));
+        ImGui::RadioButton(label.c_str(), &state.current.taa_footprint, static_cast<i32>(footprint));
+    }
+    ImGui::Checkbox("Classify TAA tiles", &state.current.taa_tile_classification);
+    if(renderer.is_taa_fp16_supported())
+    {
+        ImGui::Checkbox("FP16 TAA", &state.current.taa_fp16);
+        ImGui::Checkbox("Compare TAA precision", &state.current.compare_taa_precision);
+    } else {
+        ImGui::TextDisabled("FP16 TAA unavailable, the device is created without shaderFloat16");
+    }
+    ImGui::Checkbox("Dynamic resolution", &state.current.dynamic_resolution);
+    if(!state.current.dynamic_resolution) { ImGui::BeginDisabled(); }
+    ImGui::SliderFloat("GPU budget (ms)", &state.current.gpu_budget_ms, 4.0f, 33.3f, "%.1f");
+    if(!state.current.dynamic_resolution) { ImGui::EndDisabled(); }
+    if(state.current.dynamic_resolution) { ImGui::BeginDisabled(); }
+    ImGui::SliderFloat("Render scale", &state.current.render_scale, 0.5f, 1.0f, "%.2f");
+    if(state.current.dynamic_resolution) { ImGui::EndDisabled(); }
+
+    ImGui::Text("Scene vertices : %llu -> %llu", 
+        static_cast<unsigned long long>(scene.optimization_stats.vertices_before),
+        static_cast<unsigned long long>(scene.optimization_stats.vertices_after));
+    ImGui::Text("Scene ACMR : %.3f -> %.3f", scene.optimization_stats.acmr_before, scene.optimization_stats.acmr_after);
 
+    ImGui::Text("Drawn triangles : %llu / %llu",
+        static_cast<unsigned long long>(renderer.drawn_triangles),
+        static_cast<unsigned long long>(renderer.full_detail_triangles));
+    ImGui::Text("Visible instances : %llu, culled : %llu, draw calls : %llu",
+        static_cast<unsigned long long>(renderer.visible_instances),
+        static_cast<unsigned long long>(renderer.culled_instances),
+        static_cast<unsigned long long>(renderer.draw_calls));
+    ImGui::Text("Occluded instances : %llu", static_cast<unsigned long long>(renderer.occluded_instances));
+    if(state.current.count_overdraw) { ImGui::Text("Overdraw : %.2f fragments per pixel", renderer.overdraw); }
+    if(state.current.dynamic_resolution) { ImGui::Text("Dynamic render scale : %.2f", renderer.get_render_scale()); }
     ImGui::Text((std::string("Scene draw time took : ") + std::to_string(renderer.draw_time) + std::string(" ns")).c_str());
     ImGui::Text((std::string("TAA time took : ") + std::to_string(renderer.taa_time) + std::string(" ns")).c_str());
+    if(state.current.compare_taa_precision)
+    {
+        ImGui::Text("FP16 vs FP32 TAA : max difference %.5f, %u pixels off by more than 1/255",
+            renderer.taa_precision_max_difference, renderer.taa_precision_differing_pixels);
+    }
 
     ImGui::End();
 
@@ -152,7 +220,8 @@ Application::Application() :
         .minimized = 0u,
         .file_browser = ImGui::FileBrowser(ImGuiFileBrowserFlags_NoModal),
     },
-    renderer{window},
+    job_system{},
+    renderer{window, job_system},
     camera {{
         .position = {0.0, 0.0, 5.0},
         .front = {0.0, 0.0, -1.0},
@@ -160,16 +229,56 @@ Application::Application() :
         .aspect_ratio = 1920.0f/1080.0f,
         .fov = glm::radians(30.0f)
     }},
-    scene{"resources/suzanne_scene/suzanne.fbx"}
+    scene{"resources/suzanne_scene/suzanne.fbx", job_system}
 {
     state.file_browser.SetTitle("Select scene file");
     state.file_browser.SetTypeFilters({ ".fbx", ".obj" });
 }
 
+Application::~Application()
+{
+    // workers still reference the job system and the renderer, they have to finish first
+    cancel_scene_load();
+    for(auto & load : cancelled_scene_loads) { load->done.wait(); }
+}
+
 void Application::reload_scene(const std::string & path)
 {
-    scene = Scene(path);
-    renderer.reload_scene_data(scene);
+    cancel_scene_load();
+
+    scene_load = std::make_unique<SceneLoad>();
+    scene_load->path = path;
+    scene_load->done = std::async(std::launch::async, [this, load = scene_load.get()]
+    {
+        load->scene = std::make_unique<Scene>(load->path, job_system, &load->progress);
+        if(load->progress.cancelled) { return; }
+        load->prepared_scene = renderer.prepare_scene_data(*load->scene, &load->progress);
+    });
+}
+
+void Application::cancel_scene_load()
+{
+    if(scene_load == nullptr) { return; }
+    scene_load->progress.cancelled = true;
+    cancelled_scene_loads.push_back(std::move(scene_load));
+}
+
+void Application::update_scene_load()
+{
+    auto is_finished = [](const std::unique_ptr<SceneLoad> & load) -> bool
+    {
+        return load->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    std::erase_if(cancelled_scene_loads, is_finished);
+
+    if(scene_load == nullptr || !is_finished(scene_load)) { return; }
+    // swapping here, between two frames, keeps the renderer from ever seeing a half replaced scene
+    if(scene_load->prepared_scene != nullptr)
+    {
+        scene = std::move(*scene_load->scene);
+        renderer.swap_scene_data(std::move(scene_load->prepared_scene));
+    }
+    scene_load.reset();
 }
 
 void Application::update_app_state()
@@ -205,11 +314,48 @@ void Application::update_app_state()
         changed = true;
         renderer.change_shader_define(Define::COLOR_CLAMP, state.current.color_clamp);
     }
+    if(state.last_frame.depth_velocity != state.current.depth_velocity)
+    {
+        changed = true;
+        renderer.change_shader_define(Define::DEPTH_VELOCITY, state.current.depth_velocity);
+    }
     if(state.last_frame.jitter_camera != state.current.jitter_camera)
     {
         changed = true;
         renderer.change_shader_define(Define::JITTER, state.current.jitter_camera);
     }
+    if(state.last_frame.gpu_culling != state.current.gpu_culling)
+    {
+        renderer.set_gpu_culling(state.current.gpu_culling);
+    }
+    if(state.last_frame.occlusion_culling != state.current.occlusion_culling)
+    {
+        renderer.set_occlusion_culling(state.current.occlusion_culling);
+    }
+    if(state.last_frame.depth_prepass != state.current.depth_prepass)
+    {
+        renderer.set_depth_prepass(state.current.depth_prepass);
+    }
+    if(state.last_frame.meshlet_cone_culling != state.current.meshlet_cone_culling)
+    {
+        renderer.set_meshlet_cone_culling(state.current.meshlet_cone_culling);
+    }
+    if(state.last_frame.lod_selection != state.current.lod_selection)
+    {
+        renderer.set_lod_selection(state.current.lod_selection);
+    }
+    if(state.last_frame.static_batching != state.current.static_batching)
+    {
+        renderer.set_static_batching(state.current.static_batching);
+    }
+    if(state.last_frame.depth_sort != state.current.depth_sort)
+    {
+        renderer.set_depth_sort(state.current.depth_sort);
+    }
+    if(state.last_frame.count_overdraw != state.current.count_overdraw)
+    {
+        renderer.change_shader_define(Define::COUNT_OVERDRAW, state.current.count_overdraw);
+    }
     if(state.last_frame.nearest_depth != state.current.nearest_depth)
     {
         changed = true;
@@ -226,6 +372,41 @@ void Application::update_app_state()
         changed = true;
         renderer.change_shader_define(Define::REJECT_VELOCITY, state.current.reject_velocity);
     }
+    if(state.last_frame.taa_tile_classification != state.current.taa_tile_classification)
+    {
+        renderer.set_taa_tile_classification(state.current.taa_tile_classification);
+    }
+    if(state.last_frame.taa_fp16 != state.current.taa_fp16)
+    {
+        renderer.set_taa_fp16(state.current.taa_fp16);
+    }
+    if(state.last_frame.compare_taa_precision != state.current.compare_taa_precision)
+    {
+        renderer.set_taa_precision_comparison(state.current.compare_taa_precision);
+    }
+    if(state.last_frame.taa_footprint != state.current.taa_footprint)
+    {
+        changed = true;
+        auto footprint = static_cast<TAAFootprint>(state.current.taa_footprint);
+        renderer.change_shader_define(Define::TAA_FOOTPRINT_PLUS, footprint == TAAFootprint::PLUS);
+        renderer.change_shader_define(Define::TAA_FOOTPRINT_SEPARABLE, footprint == TAAFootprint::SEPARABLE);
+    }
+    if(state.last_frame.large_taa_tiles != state.current.large_taa_tiles)
+    {
+        changed = true;
+        renderer.set_taa_tile_size(state.current.large_taa_tiles ? 16 : 8);
+    }
+    if(state.last_frame.dynamic_resolution != state.current.dynamic_resolution ||
+       state.last_frame.gpu_budget_ms != state.current.gpu_budget_ms)
+    {
+        renderer.set_dynamic_resolution(state.current.dynamic_resolution, state.current.gpu_budget_ms);
+        // back to the manually chosen scale once the controller lets go
+        if(!state.current.dynamic_resolution) { renderer.set_render_scale(state.current.render_scale); }
+    }
+    if(state.last_frame.render_scale != state.current.render_scale && !state.current.dynamic_resolution)
+    {
+        renderer.set_render_scale(state.current.render_scale);
+    }
     if(changed) { renderer.reload_taa_pipeline(); }
     state.last_frame = state.current;
 }
@@ -237,6 +418,7 @@ void Application::main_loop()
         glfwPollEvents();
         ui_update();
         update_app_state();
+        update_scene_load();
 
         if (state.minimized != 0u) { DEBUG_OUT("[Application::main_loop()] Window minimized "); continue; } 
         renderer.draw(camera);
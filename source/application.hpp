@@ -1,9 +1,14 @@
 #pragma once
 
+#include <future>
+#include <memory>
+#include <vector>
+
 #include "external/imgui_file_dialog.hpp"
 #include "window.hpp"
 #include "types.hpp"
 #include "scene.hpp"
+#include "job_system.hpp"
 #include "renderer/renderer.hpp"
 
 struct Application 
@@ -11,11 +16,36 @@ struct Application
     struct CheckboxState
     {
         bool jitter_camera = true;
+        bool gpu_culling = true;
+        bool occlusion_culling = true;
+        bool depth_prepass = false;
+        bool meshlet_cone_culling = true;
+        bool lod_selection = true;
+        bool static_batching = false;
+        bool depth_sort = true;
+        bool count_overdraw = false;
         bool reject_velocity = true;
         bool reproject_velocity = true;
         bool color_clamp = true;
         bool nearest_depth = true;
         bool accumulate = true;
+        // camera motion reconstructed from depth instead of the velocity attachment
+        bool depth_velocity = false;
+        // 16x16 instead of 8x8 TAA workgroups
+        bool large_taa_tiles = false;
+        // static, moving and disoccluded tiles each get their own resolve kernel
+        bool taa_tile_classification = true;
+        // half precision TAA colors, only offered when the renderer reports device support
+        bool taa_fp16 = false;
+        // diff the half precision TAA output against a single precision resolve every frame
+        bool compare_taa_precision = false;
+        // TAAFootprint of the TAA neighborhood statistics
+        i32 taa_footprint = static_cast<i32>(TAAFootprint::SQUARE);
+        // scene resolution relative to the window, TAA upsamples below one
+        f32 render_scale = 1.0f;
+        // the renderer picks the scale itself to stay within the GPU budget
+        bool dynamic_resolution = false;
+        f32 gpu_budget_ms = 16.6f;
     };
 
     struct AppState
@@ -50,18 +80,32 @@ struct Application
         CheckboxState current;
     };
 
+    // Scene import and GPU preparation running on a worker thread while the current scene keeps rendering
+    struct SceneLoad
+    {
+        std::string path;
+        SceneLoadProgress progress;
+        std::unique_ptr<Scene> scene;
+        std::unique_ptr<PreparedScene> prepared_scene;
+        std::future<void> done;
+    };
+
     public:
         Application();
-        ~Application() = default;
+        ~Application();
 
         void main_loop();
 
     private:
         AppWindow window;
         AppState state;
+        JobSystem job_system;
         Renderer renderer;
         Camera camera;
         Scene scene;
+        std::unique_ptr<SceneLoad> scene_load;
+        // cancelled loads are kept alive until their worker notices the cancellation and finishes
+        std::vector<std::unique_ptr<SceneLoad>> cancelled_scene_loads;
 
         void init_window();
         void mouse_callback(const f64 x, const f64 y);
@@ -69,6 +113,8 @@ struct Application
         void window_resize_callback(const i32 width, const i32 height);
         void key_callback(const i32 key, const i32 code, const i32 action, const i32 mods);
         void reload_scene(const std::string & path);
+        void cancel_scene_load();
+        void update_scene_load();
         void ui_update();
         void update_app_state();
 };
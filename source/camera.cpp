@@ -61,20 +61,20 @@ void Camera::update_front_vector(f32 x_offset, f32 y_offset)
 }
 
 // source - http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
-auto Camera::get_camera_jitter_matrix(const f32vec2 swapchain_extent) -> f32mat4x4
+auto Camera::get_camera_jitter_matrix(const f32vec2 render_extent, u32 phase_count) -> f32mat4x4
 {
-    f32vec2 jitter_scale = f32vec2(1.0f/f32(swapchain_extent.x), 1.0f/f32(swapchain_extent.y));
+    // one pixel spans two units of NDC, offsets span a whole pixel
+    f32vec2 jitter_scale = f32vec2(2.0f/f32(render_extent.x), 2.0f/f32(render_extent.y));
     f32 g = 1.32471795724474602596f;
     f32 a1 = 1.0f / g;
     f32 a2 = 1.0f / (g * g);
 
-    f32 tmp = glm::mod(0.5f + a1 * (jitter_idx + 1.0f), 1.0f) - 0.5f;
     f32vec2 jitter = f32vec2(
         glm::mod(0.5f + a1 * (jitter_idx + 1.0f), 1.0f) - 0.5f,
         glm::mod(0.5f + a2 * (jitter_idx + 1.0f), 1.0f) - 0.5f
     );
     jitter = jitter * jitter_scale;
-    jitter_idx = (jitter_idx + 1) % 32; 
+    jitter_idx = (jitter_idx + 1) % phase_count;
     f32mat4x4 jitter_mat(1.0);
     jitter_mat[3][0] = jitter.x;
     jitter_mat[3][1] = jitter.y;
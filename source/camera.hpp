@@ -30,7 +30,8 @@ struct Camera
     void update_front_vector(f32 x_offset, f32 y_offset);
     [[nodiscard]] auto get_camera_position() const -> f32vec3;
     [[nodiscard]] auto get_view_projection_matrix(const GetViewProjectionInfo & info) -> f32mat4x4;
-    [[nodiscard]] auto get_camera_jitter_matrix(const f32vec2 swapchain_extent) -> f32mat4x4;
+    // subpixel offset of the render resolution, the R2 sequence repeats after phase_count frames
+    [[nodiscard]] auto get_camera_jitter_matrix(const f32vec2 render_extent, u32 phase_count) -> f32mat4x4;
 
     private:
 
@@ -0,0 +1,140 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // identifies the worker thread calling into a job system, threads outside any job system have no owner
+    thread_local const JobSystem * tls_owner = nullptr;
+    thread_local u32 tls_queue_index = 0u;
+}
+
+JobSystem::JobSystem(u32 thread_count)
+{
+    if(thread_count == 0u)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+    }
+
+    // last queue is shared by all threads not owned by the job system
+    for(u32 queue = 0; queue < thread_count + 1u; queue++)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    workers.reserve(thread_count);
+    for(u32 worker = 0; worker < thread_count; worker++)
+    {
+        workers.emplace_back([this, worker]() { worker_loop(worker); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running = false;
+    }
+    wake_up.notify_all();
+    for(auto & worker : workers) { worker.join(); }
+}
+
+auto JobSystem::get_own_queue_index() const -> u32
+{
+    return tls_owner == this ? tls_queue_index : static_cast<u32>(workers.size());
+}
+
+void JobSystem::dispatch(JobCounter & counter, Job job)
+{
+    counter.pending.fetch_add(1u, std::memory_order_relaxed);
+    // counted before the task becomes visible, a thief taking it right away must not decrement below zero
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued_tasks.fetch_add(1u, std::memory_order_relaxed);
+    }
+    {
+        auto & queue = *queues.at(get_own_queue_index());
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{.job = std::move(job), .counter = &counter});
+    }
+    wake_up.notify_one();
+}
+
+auto JobSystem::try_run_task(u32 queue_index) -> bool
+{
+    Task task;
+    bool found = false;
+    {
+        auto & own_queue = *queues.at(queue_index);
+        std::lock_guard<std::mutex> lock(own_queue.mutex);
+        if(!own_queue.tasks.empty())
+        {
+            task = std::move(own_queue.tasks.back());
+            own_queue.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    for(usize offset = 1; !found && offset < queues.size(); offset++)
+    {
+        auto & victim_queue = *queues.at((queue_index + offset) % queues.size());
+        std::lock_guard<std::mutex> lock(victim_queue.mutex);
+        if(!victim_queue.tasks.empty())
+        {
+            task = std::move(victim_queue.tasks.front());
+            victim_queue.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if(!found) { return false; }
+
+    queued_tasks.fetch_sub(1u, std::memory_order_relaxed);
+    task.job();
+    task.counter->pending.fetch_sub(1u, std::memory_order_release);
+    return true;
+}
+
+void JobSystem::worker_loop(u32 queue_index)
+{
+    tls_owner = this;
+    tls_queue_index = queue_index;
+
+    while(true)
+    {
+        if(try_run_task(queue_index)) { continue; }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake_up.wait(lock, [this]() { return !running || queued_tasks.load(std::memory_order_relaxed) > 0u; });
+        if(!running) { return; }
+    }
+}
+
+void JobSystem::wait(JobCounter & counter)
+{
+    u32 queue_index = get_own_queue_index();
+    while(!counter.is_done())
+    {
+        if(!try_run_task(queue_index)) { std::this_thread::yield(); }
+    }
+}
+
+void JobSystem::parallel_for(usize count, usize batch_size, const std::function<void(usize, usize)> & job)
+{
+    if(count == 0) { return; }
+    batch_size = std::max(batch_size, usize(1));
+    // nothing to gain from going wide
+    if(count <= batch_size || workers.empty())
+    {
+        job(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for(usize begin = 0; begin < count; begin += batch_size)
+    {
+        usize end = std::min(begin + batch_size, count);
+        dispatch(counter, [&job, begin, end]() { job(begin, end); });
+    }
+    wait(counter);
+}
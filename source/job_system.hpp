@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.hpp"
+
+// Tracks the number of outstanding jobs dispatched against it
+struct JobCounter
+{
+    std::atomic<u32> pending = 0u;
+
+    [[nodiscard]] auto is_done() const -> bool { return pending.load(std::memory_order_acquire) == 0u; }
+};
+
+// Work stealing scheduler - every worker owns a queue it pushes to and pops from the back (LIFO),
+// idle workers steal from the front of the other queues (FIFO). Threads not owned by the job system
+// share one extra queue. Waiting threads keep executing jobs instead of blocking, so it is safe to
+// dispatch and wait from inside of a job.
+struct JobSystem
+{
+    using Job = std::function<void()>;
+
+    // thread_count == 0 means one worker per hardware thread except for the calling one
+    explicit JobSystem(u32 thread_count = 0u);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem & operator=(const JobSystem &) = delete;
+
+    void dispatch(JobCounter & counter, Job job);
+    void wait(JobCounter & counter);
+
+    // Splits [0, count) into batches of batch_size and runs job(begin, end) for each of them, returns once all are done
+    void parallel_for(usize count, usize batch_size, const std::function<void(usize, usize)> & job);
+
+    [[nodiscard]] auto get_worker_count() const -> u32 { return static_cast<u32>(workers.size()); }
+
+    private:
+        struct Task
+        {
+            Job job;
+            JobCounter * counter;
+        };
+
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex sleep_mutex;
+        std::condition_variable wake_up;
+        // only incremented while holding sleep_mutex so that sleeping workers never miss a wake up
+        std::atomic<u32> queued_tasks = 0u;
+        bool running = true;
+
+        void worker_loop(u32 queue_index);
+        [[nodiscard]] auto get_own_queue_index() const -> u32;
+        [[nodiscard]] auto try_run_task(u32 queue_index) -> bool;
+};
+
+// Exclusive prefix sum of sizes, returns the total
+template<typename T>
+auto exclusive_prefix_sum(std::vector<T> & values) -> T
+{
+    T sum = 0;
+    for(auto & value : values)
+    {
+        T current = value;
+        value = sum;
+        sum += current;
+    }
+    return sum;
+}
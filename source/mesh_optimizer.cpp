@@ -0,0 +1,215 @@
+#include "mesh_optimizer.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+auto MeshOptimizationStats::operator+=(const MeshOptimizationStats & other) -> MeshOptimizationStats &
+{
+    vertices_before += other.vertices_before;
+    vertices_after += other.vertices_after;
+    cache_misses_before += other.cache_misses_before;
+    cache_misses_after += other.cache_misses_after;
+    triangles += other.triangles;
+    return *this;
+}
+
+auto simulate_vertex_cache_misses(const std::vector<u32> & indices, u32 vertex_count, u32 cache_size) -> u64
+{
+    // a vertex is in the cache when it was pushed less than cache_size pushes ago
+    std::vector<u64> push_time(vertex_count, 0ull);
+    u64 time = static_cast<u64>(cache_size) + 1ull;
+    u64 misses = 0;
+    for(u32 index : indices)
+    {
+        if(time - push_time[index] > cache_size)
+        {
+            push_time[index] = time;
+            time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+void deduplicate_vertices(RuntimeMesh & mesh)
+{
+    struct VertexHasher
+    {
+        auto operator()(const Vertex & vertex) const -> usize
+        {
+            u32 words[sizeof(Vertex) / sizeof(u32)];
+            memcpy(words, &vertex, sizeof(Vertex));
+            usize hash = 0;
+            for(u32 word : words) { hash = (hash ^ word) * 0x9e3779b97f4a7c15ull; }
+            return hash;
+        }
+    };
+    struct VertexEqual
+    {
+        auto operator()(const Vertex & first, const Vertex & second) const -> bool
+        {
+            return memcmp(&first, &second, sizeof(Vertex)) == 0;
+        }
+    };
+
+    std::unordered_map<Vertex, u32, VertexHasher, VertexEqual> unique_vertices;
+    unique_vertices.reserve(mesh.vertices.size());
+
+    std::vector<u32> remap(mesh.vertices.size());
+    std::vector<Vertex> new_vertices;
+    new_vertices.reserve(mesh.vertices.size());
+    for(usize vertex = 0; vertex < mesh.vertices.size(); vertex++)
+    {
+        auto [it, inserted] = unique_vertices.try_emplace(mesh.vertices[vertex], static_cast<u32>(new_vertices.size()));
+        if(inserted) { new_vertices.push_back(mesh.vertices[vertex]); }
+        remap[vertex] = it->second;
+    }
+
+    for(auto & index : mesh.indices) { index = remap[index]; }
+    mesh.vertices = std::move(new_vertices);
+}
+
+void optimize_vertex_cache(std::vector<u32> & indices, u32 vertex_count, u32 cache_size)
+{
+    const u32 triangle_count = static_cast<u32>(indices.size() / 3);
+    if(triangle_count == 0) { return; }
+
+    // vertex -> triangle adjacency stored as offsets into one flat array
+    std::vector<u32> live_triangles(vertex_count, 0u);
+    for(u32 index : indices) { live_triangles[index]++; }
+
+    std::vector<u32> adjacency_offsets(vertex_count + 1, 0u);
+    for(u32 vertex = 0; vertex < vertex_count; vertex++)
+    {
+        adjacency_offsets[vertex + 1] = adjacency_offsets[vertex] + live_triangles[vertex];
+    }
+    std::vector<u32> adjacency(indices.size());
+    {
+        std::vector<u32> fill = adjacency_offsets;
+        for(u32 triangle = 0; triangle < triangle_count; triangle++)
+        {
+            for(u32 corner = 0; corner < 3; corner++)
+            {
+                adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+            }
+        }
+    }
+
+    std::vector<u64> cache_time(vertex_count, 0ull);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<u32> dead_end_stack;
+    std::vector<u32> candidates;
+    std::vector<u32> new_indices;
+    new_indices.reserve(indices.size());
+
+    u64 time = static_cast<u64>(cache_size) + 1ull;
+    u32 cursor = 0;
+    i64 fanning_vertex = 0;
+
+    auto get_next_vertex = [&]() -> i64
+    {
+        // prefer the candidate that stays in the cache the longest after its remaining triangles are emitted,
+        // candidates that would fall out of it are not taken and leave the choice to the dead-end stack
+        i64 best_vertex = -1;
+        i64 best_priority = 0;
+        for(u32 candidate : candidates)
+        {
+            if(live_triangles[candidate] == 0) { continue; }
+            i64 priority = 0;
+            if(time - cache_time[candidate] + 2 * live_triangles[candidate] <= cache_size)
+            {
+                priority = static_cast<i64>(time - cache_time[candidate]);
+            }
+            if(priority > best_priority)
+            {
+                best_priority = priority;
+                best_vertex = candidate;
+            }
+        }
+        if(best_vertex != -1) { return best_vertex; }
+
+        // dead end - try recently used vertices first, then fall back to input order
+        while(!dead_end_stack.empty())
+        {
+            u32 vertex = dead_end_stack.back();
+            dead_end_stack.pop_back();
+            if(live_triangles[vertex] > 0) { return vertex; }
+        }
+        while(cursor < vertex_count)
+        {
+            if(live_triangles[cursor] > 0) { return cursor; }
+            cursor++;
+        }
+        return -1;
+    };
+
+    while(fanning_vertex >= 0)
+    {
+        candidates.clear();
+        for(u32 adjacent = adjacency_offsets[fanning_vertex]; adjacent < adjacency_offsets[fanning_vertex + 1]; adjacent++)
+        {
+            u32 triangle = adjacency[adjacent];
+            if(emitted[triangle]) { continue; }
+
+            for(u32 corner = 0; corner < 3; corner++)
+            {
+                u32 vertex = indices[triangle * 3 + corner];
+                new_indices.push_back(vertex);
+                dead_end_stack.push_back(vertex);
+                candidates.push_back(vertex);
+                live_triangles[vertex]--;
+                if(time - cache_time[vertex] > cache_size)
+                {
+                    cache_time[vertex] = time;
+                    time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+        fanning_vertex = get_next_vertex();
+    }
+
+    indices = std::move(new_indices);
+}
+
+void optimize_vertex_cache(RuntimeMesh & mesh, u32 cache_size)
+{
+    optimize_vertex_cache(mesh.indices, static_cast<u32>(mesh.vertices.size()), cache_size);
+}
+
+void optimize_vertex_fetch(RuntimeMesh & mesh)
+{
+    const u32 INVALID_INDEX = ~0u;
+    std::vector<u32> remap(mesh.vertices.size(), INVALID_INDEX);
+    std::vector<Vertex> new_vertices;
+    new_vertices.reserve(mesh.vertices.size());
+
+    for(auto & index : mesh.indices)
+    {
+        if(remap[index] == INVALID_INDEX)
+        {
+            remap[index] = static_cast<u32>(new_vertices.size());
+            new_vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    // vertices not referenced by any triangle are dropped
+    mesh.vertices = std::move(new_vertices);
+}
+
+auto optimize_mesh(RuntimeMesh & mesh) -> MeshOptimizationStats
+{
+    MeshOptimizationStats stats = {
+        .vertices_before = mesh.vertices.size(),
+        .cache_misses_before = simulate_vertex_cache_misses(mesh.indices, static_cast<u32>(mesh.vertices.size())),
+        .triangles = mesh.indices.size() / 3,
+    };
+
+    deduplicate_vertices(mesh);
+    optimize_vertex_cache(mesh);
+    optimize_vertex_fetch(mesh);
+
+    stats.vertices_after = mesh.vertices.size();
+    stats.cache_misses_after = simulate_vertex_cache_misses(mesh.indices, static_cast<u32>(mesh.vertices.size()));
+    return stats;
+}
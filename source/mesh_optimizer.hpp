@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "types.hpp"
+#include "scene.hpp"
+
+// Size of the simulated post-transform vertex cache, matches what most desktop GPUs effectively provide
+const u32 VERTEX_CACHE_SIZE = 16u;
+
+struct MeshOptimizationStats
+{
+    u64 vertices_before = 0;
+    u64 vertices_after = 0;
+    // cache misses are accumulated instead of ACMR so that stats of several meshes can be summed
+    u64 cache_misses_before = 0;
+    u64 cache_misses_after = 0;
+    u64 triangles = 0;
+
+    [[nodiscard]] auto get_acmr_before() const -> f32 { return triangles > 0 ? f32(cache_misses_before) / f32(triangles) : 0.0f; }
+    [[nodiscard]] auto get_acmr_after() const -> f32 { return triangles > 0 ? f32(cache_misses_after) / f32(triangles) : 0.0f; }
+
+    auto operator+=(const MeshOptimizationStats & other) -> MeshOptimizationStats &;
+};
+
+// Number of vertex shader invocations when drawing the indices through a FIFO cache of cache_size entries
+[[nodiscard]] auto simulate_vertex_cache_misses(const std::vector<u32> & indices, u32 vertex_count, u32 cache_size = VERTEX_CACHE_SIZE) -> u64;
+
+// Merges bitwise identical vertices and remaps the indices accordingly
+void deduplicate_vertices(RuntimeMesh & mesh);
+// Reorders triangles for post-transform cache locality (Tipsify - Sander, Nehab, Barczak 2007)
+void optimize_vertex_cache(std::vector<u32> & indices, u32 vertex_count, u32 cache_size = VERTEX_CACHE_SIZE);
+void optimize_vertex_cache(RuntimeMesh & mesh, u32 cache_size = VERTEX_CACHE_SIZE);
+// Reorders vertices in the order they are first referenced by the index buffer
+void optimize_vertex_fetch(RuntimeMesh & mesh);
+
+// Runs all of the above in order
+auto optimize_mesh(RuntimeMesh & mesh) -> MeshOptimizationStats;
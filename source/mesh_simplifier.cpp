@@ -0,0 +1,305 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "mesh_optimizer.hpp"
+
+namespace
+{
+    // Symmetric 4x4 matrix of the summed squared plane distances, weighted by triangle area
+    struct Quadric
+    {
+        // xx xy xz xw yy yz yw zz zw ww
+        std::array<f64, 10> a = {};
+        f64 weight = 0.0;
+
+        void add_plane(const f64vec3 & normal, f64 distance, f64 plane_weight)
+        {
+            a[0] += plane_weight * normal.x * normal.x;
+            a[1] += plane_weight * normal.x * normal.y;
+            a[2] += plane_weight * normal.x * normal.z;
+            a[3] += plane_weight * normal.x * distance;
+            a[4] += plane_weight * normal.y * normal.y;
+            a[5] += plane_weight * normal.y * normal.z;
+            a[6] += plane_weight * normal.y * distance;
+            a[7] += plane_weight * normal.z * normal.z;
+            a[8] += plane_weight * normal.z * distance;
+            a[9] += plane_weight * distance * distance;
+            weight += plane_weight;
+        }
+
+        auto operator+=(const Quadric & other) -> Quadric &
+        {
+            for(usize i = 0; i < a.size(); i++) { a[i] += other.a[i]; }
+            weight += other.weight;
+            return *this;
+        }
+    };
+
+    // Mean squared distance of the point from the planes accumulated in first + second
+    auto evaluate_quadric_pair(const Quadric & first, const Quadric & second, const f32vec3 & point) -> f64
+    {
+        std::array<f64, 10> q;
+        for(usize i = 0; i < q.size(); i++) { q[i] = first.a[i] + second.a[i]; }
+        f64 weight = first.weight + second.weight;
+        f64 x = point.x;
+        f64 y = point.y;
+        f64 z = point.z;
+        f64 error =
+            q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x +
+            q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y +
+            q[7] * z * z + 2.0 * q[8] * z +
+            q[9];
+        return weight > 0.0 ? std::abs(error) / weight : 0.0;
+    }
+
+    struct Collapse
+    {
+        u32 from;
+        u32 to;
+        f64 error;
+    };
+}
+
+void generate_mesh_lods(RuntimeMesh & mesh)
+{
+    mesh.lods.clear();
+    const u32 triangle_count = static_cast<u32>(mesh.indices.size() / 3);
+    if(triangle_count < MIN_LOD_TRIANGLES) { return; }
+
+    // weld vertices sharing a position (normal seams) so that the topology is connected across them,
+    // every position is represented by the first vertex using it
+    const u32 vertex_count = static_cast<u32>(mesh.vertices.size());
+    std::vector<u32> canonical(vertex_count);
+    {
+        struct PositionHasher
+        {
+            auto operator()(const f32vec3 & position) const -> usize
+            {
+                u32 words[3];
+                memcpy(words, &position, sizeof(words));
+                return ((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+            }
+        };
+        std::unordered_map<f32vec3, u32, PositionHasher> positions;
+        positions.reserve(vertex_count);
+        for(u32 vertex = 0; vertex < vertex_count; vertex++)
+        {
+            canonical[vertex] = positions.try_emplace(mesh.vertices[vertex].position, vertex).first->second;
+        }
+    }
+
+    // triangles keep the original vertices of their corners, the current welded vertex is resolved through collapsed_into
+    std::vector<u32> triangles;
+    triangles.reserve(mesh.indices.size());
+    for(u32 triangle = 0; triangle < triangle_count; triangle++)
+    {
+        u32 i0 = mesh.indices[triangle * 3 + 0];
+        u32 i1 = mesh.indices[triangle * 3 + 1];
+        u32 i2 = mesh.indices[triangle * 3 + 2];
+        if(canonical[i0] == canonical[i1] || canonical[i1] == canonical[i2] || canonical[i0] == canonical[i2]) { continue; }
+        triangles.insert(triangles.end(), {i0, i1, i2});
+    }
+
+    std::vector<u32> collapsed_into(vertex_count);
+    for(u32 vertex = 0; vertex < vertex_count; vertex++) { collapsed_into[vertex] = vertex; }
+    auto resolve = [&](u32 vertex) -> u32
+    {
+        u32 root = canonical[vertex];
+        while(collapsed_into[root] != root) { root = collapsed_into[root]; }
+        // path compression
+        u32 current = canonical[vertex];
+        while(collapsed_into[current] != root)
+        {
+            u32 next = collapsed_into[current];
+            collapsed_into[current] = root;
+            current = next;
+        }
+        return root;
+    };
+    auto get_position = [&](u32 vertex) -> const f32vec3 & { return mesh.vertices[vertex].position; };
+    auto make_edge_key = [](u32 first, u32 second) -> u64
+    {
+        return (static_cast<u64>(std::min(first, second)) << 32ull) | static_cast<u64>(std::max(first, second));
+    };
+
+    std::vector<Quadric> quadrics(vertex_count);
+    std::unordered_map<u64, u32> edge_use_counts;
+    edge_use_counts.reserve(triangles.size());
+    for(usize triangle = 0; triangle < triangles.size(); triangle += 3)
+    {
+        std::array<u32, 3> corners = {canonical[triangles[triangle]], canonical[triangles[triangle + 1]], canonical[triangles[triangle + 2]]};
+        f64vec3 p0 = f64vec3(get_position(corners[0]));
+        f64vec3 p1 = f64vec3(get_position(corners[1]));
+        f64vec3 p2 = f64vec3(get_position(corners[2]));
+        f64vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        f64 double_area = glm::length(normal);
+        if(double_area > 0.0)
+        {
+            normal /= double_area;
+            for(u32 corner : corners) { quadrics[corner].add_plane(normal, -glm::dot(normal, p0), double_area * 0.5); }
+        }
+        for(u32 corner = 0; corner < 3; corner++) { edge_use_counts[make_edge_key(corners[corner], corners[(corner + 1) % 3])]++; }
+    }
+
+    // vertices on open or non manifold edges stay where they are so that borders and cracks do not move
+    std::vector<bool> locked(vertex_count, false);
+    for(const auto & [edge, use_count] : edge_use_counts)
+    {
+        if(use_count != 2)
+        {
+            locked[static_cast<u32>(edge >> 32ull)] = true;
+            locked[static_cast<u32>(edge & 0xFFFFFFFFull)] = true;
+        }
+    }
+    edge_use_counts = {};
+
+    // Upper bound of the distance between every original vertex and the welded vertex it was collapsed into,
+    // accumulated through the triangle inequality. The quadric error only orders the collapses, it is an area
+    // weighted mean of squared plane distances and no bound of how far the surface moved.
+    std::vector<f64> deviations(vertex_count, 0.0);
+    f64 max_error = 0.0;
+    u32 previous_lod_triangles = triangle_count;
+    u32 target_triangles = triangle_count / 2;
+
+    std::vector<u32> adjacency_offsets(vertex_count + 1);
+    std::vector<u32> adjacency;
+    std::vector<u64> edges;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertex_count);
+
+    auto emit_lod = [&]()
+    {
+        // corners which did not move keep their original vertex and with it their normal
+        auto & lod = mesh.lods.emplace_back(MeshLod{.error = static_cast<f32>(max_error)});
+        lod.indices.reserve(triangles.size());
+        for(u32 corner : triangles)
+        {
+            u32 current = resolve(corner);
+            lod.indices.push_back(current == canonical[corner] ? corner : current);
+        }
+        optimize_vertex_cache(lod.indices, vertex_count);
+        previous_lod_triangles = static_cast<u32>(triangles.size() / 3);
+        target_triangles = previous_lod_triangles / 2;
+    };
+
+    while(mesh.lods.size() < MAX_MESH_LODS - 1 && target_triangles >= MIN_LOD_TRIANGLES / 2)
+    {
+        // welded vertex -> triangle adjacency of the current mesh
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0u);
+        for(u32 corner : triangles) { adjacency_offsets[resolve(corner) + 1]++; }
+        for(u32 vertex = 0; vertex < vertex_count; vertex++) { adjacency_offsets[vertex + 1] += adjacency_offsets[vertex]; }
+        adjacency.resize(triangles.size());
+        {
+            std::vector<u32> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+            for(usize corner = 0; corner < triangles.size(); corner++)
+            {
+                adjacency[fill[resolve(triangles[corner])]++] = static_cast<u32>(corner / 3);
+            }
+        }
+
+        edges.clear();
+        for(usize triangle = 0; triangle < triangles.size(); triangle += 3)
+        {
+            for(u32 corner = 0; corner < 3; corner++)
+            {
+                edges.push_back(make_edge_key(resolve(triangles[triangle + corner]), resolve(triangles[triangle + (corner + 1) % 3])));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        // collapse every edge onto the endpoint with the lower error
+        collapses.clear();
+        for(u64 edge : edges)
+        {
+            u32 first = static_cast<u32>(edge >> 32ull);
+            u32 second = static_cast<u32>(edge & 0xFFFFFFFFull);
+            f64 first_into_second = locked[first] ? INFINITY : evaluate_quadric_pair(quadrics[first], quadrics[second], get_position(second));
+            f64 second_into_first = locked[second] ? INFINITY : evaluate_quadric_pair(quadrics[first], quadrics[second], get_position(first));
+            if(std::isinf(first_into_second) && std::isinf(second_into_first)) { continue; }
+            if(first_into_second <= second_into_first) { collapses.push_back({first, second, first_into_second}); }
+            else                                       { collapses.push_back({second, first, second_into_first}); }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse & a, const Collapse & b) { return a.error < b.error; });
+
+        // apply the cheapest independent collapses until the target is reached, a vertex whose neighbourhood
+        // already changed in this pass waits for the next one so that the flip test sees up to date triangles
+        std::fill(touched.begin(), touched.end(), false);
+        u32 current_triangles = static_cast<u32>(triangles.size() / 3);
+        u32 applied = 0;
+        for(const auto & collapse : collapses)
+        {
+            if(current_triangles <= target_triangles) { break; }
+            if(touched[collapse.from] || touched[collapse.to]) { continue; }
+
+            u32 removed_triangles = 0;
+            bool flips = false;
+            for(u32 adjacent = adjacency_offsets[collapse.from]; adjacent < adjacency_offsets[collapse.from + 1]; adjacent++)
+            {
+                u32 triangle = adjacency[adjacent] * 3;
+                std::array<u32, 3> corners = {resolve(triangles[triangle]), resolve(triangles[triangle + 1]), resolve(triangles[triangle + 2])};
+                if(corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to)
+                {
+                    removed_triangles++;
+                    continue;
+                }
+
+                f32vec3 normal_before = glm::cross(get_position(corners[1]) - get_position(corners[0]), get_position(corners[2]) - get_position(corners[0]));
+                for(auto & corner : corners) { if(corner == collapse.from) { corner = collapse.to; } }
+                f32vec3 normal_after = glm::cross(get_position(corners[1]) - get_position(corners[0]), get_position(corners[2]) - get_position(corners[0]));
+
+                f32 length_product = glm::length(normal_before) * glm::length(normal_after);
+                if(length_product < EPSILON || glm::dot(normal_before, normal_after) < 0.2f * length_product)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if(flips) { continue; }
+
+            collapsed_into[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            f64 moved = glm::distance(f64vec3(get_position(collapse.from)), f64vec3(get_position(collapse.to)));
+            deviations[collapse.to] = std::max(deviations[collapse.to], deviations[collapse.from] + moved);
+            max_error = std::max(max_error, deviations[collapse.to]);
+            current_triangles -= std::min(removed_triangles, current_triangles);
+            applied++;
+
+            for(u32 adjacent = adjacency_offsets[collapse.from]; adjacent < adjacency_offsets[collapse.from + 1]; adjacent++)
+            {
+                u32 triangle = adjacency[adjacent] * 3;
+                for(u32 corner = 0; corner < 3; corner++) { touched[resolve(triangles[triangle + corner])] = true; }
+            }
+            touched[collapse.from] = true;
+        }
+
+        // drop triangles which became degenerate
+        usize kept = 0;
+        for(usize triangle = 0; triangle < triangles.size(); triangle += 3)
+        {
+            u32 c0 = resolve(triangles[triangle]);
+            u32 c1 = resolve(triangles[triangle + 1]);
+            u32 c2 = resolve(triangles[triangle + 2]);
+            if(c0 == c1 || c1 == c2 || c0 == c2) { continue; }
+            for(u32 corner = 0; corner < 3; corner++) { triangles[kept + corner] = triangles[triangle + corner]; }
+            kept += 3;
+        }
+        triangles.resize(kept);
+
+        if(triangles.size() / 3 <= target_triangles)
+        {
+            emit_lod();
+        }
+        else if(applied == 0)
+        {
+            // simplification got stuck, keep what there is if it is still a meaningful reduction
+            if(triangles.size() / 3 < previous_lod_triangles * 9 / 10) { emit_lod(); }
+            break;
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+#include "types.hpp"
+#include "scene.hpp"
+
+// Meshes with fewer triangles gain nothing from levels of detail
+const u32 MIN_LOD_TRIANGLES = 64u;
+
+// Fills mesh.lods with up to MAX_MESH_LODS - 1 levels of detail, each one halving the triangle count of the
+// previous one. Uses quadric error metric edge collapses (Garland, Heckbert 1997) onto existing vertices so
+// all levels share the vertex buffer of the full detail mesh. Open borders are kept in place.
+void generate_mesh_lods(RuntimeMesh & mesh);
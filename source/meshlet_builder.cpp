@@ -0,0 +1,126 @@
+#include "meshlet_builder.hpp"
+
+#include <cmath>
+
+static void compute_meshlet_bounds(std::span<const Vertex> vertices, std::span<const u32> indices, Meshlet & meshlet)
+{
+    auto triangles = indices.subspan(meshlet.first_index, meshlet.index_count);
+
+    f32vec3 aabb_min = vertices[triangles[0]].position;
+    f32vec3 aabb_max = vertices[triangles[0]].position;
+    for(u32 index : triangles)
+    {
+        aabb_min = glm::min(aabb_min, vertices[index].position);
+        aabb_max = glm::max(aabb_max, vertices[index].position);
+    }
+    meshlet.center = (aabb_min + aabb_max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for(u32 index : triangles)
+    {
+        meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[index].position - meshlet.center));
+    }
+
+    // normal cone - the axis is the average triangle normal, the spread is given by the least aligned triangle
+    std::vector<f32vec3> triangle_normals;
+    triangle_normals.reserve(triangles.size() / 3);
+    f32vec3 normal_sum = f32vec3(0.0f);
+    for(usize triangle = 0; triangle < triangles.size(); triangle += 3)
+    {
+        const f32vec3 & p0 = vertices[triangles[triangle + 0]].position;
+        const f32vec3 & p1 = vertices[triangles[triangle + 1]].position;
+        const f32vec3 & p2 = vertices[triangles[triangle + 2]].position;
+        f32vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        f32 area = glm::length(normal);
+        // degenerate triangles can not be backfacing
+        if(area < EPSILON) { continue; }
+        triangle_normals.push_back(normal / area);
+        normal_sum += normal / area;
+    }
+
+    meshlet.cone_apex = meshlet.center;
+    meshlet.cone_axis = f32vec3(0.0f, 0.0f, 1.0f);
+    meshlet.cone_cutoff = MESHLET_NO_CONE_CUTOFF;
+    if(triangle_normals.empty() || glm::length(normal_sum) < EPSILON) { return; }
+
+    meshlet.cone_axis = glm::normalize(normal_sum);
+    f32 min_alignment = 1.0f;
+    for(const auto & normal : triangle_normals)
+    {
+        min_alignment = glm::min(min_alignment, glm::dot(normal, meshlet.cone_axis));
+    }
+    // spread close to or over 90 degrees, the cone would almost never cull anything
+    if(min_alignment <= 0.1f) { return; }
+
+    // move the apex back along the axis until every triangle plane lies in front of it
+    f32 apex_distance = 0.0f;
+    usize normal_idx = 0;
+    for(usize triangle = 0; triangle < triangles.size(); triangle += 3)
+    {
+        const f32vec3 & p0 = vertices[triangles[triangle + 0]].position;
+        const f32vec3 & p1 = vertices[triangles[triangle + 1]].position;
+        const f32vec3 & p2 = vertices[triangles[triangle + 2]].position;
+        if(glm::length(glm::cross(p1 - p0, p2 - p0)) < EPSILON) { continue; }
+
+        const f32vec3 & normal = triangle_normals[normal_idx++];
+        f32 center_distance = glm::dot(meshlet.center - p0, normal);
+        apex_distance = glm::max(apex_distance, center_distance / glm::dot(meshlet.cone_axis, normal));
+    }
+    meshlet.cone_apex = meshlet.center - meshlet.cone_axis * apex_distance;
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_alignment * min_alignment);
+}
+
+auto build_meshlets(std::span<const Vertex> vertices, std::span<const u32> indices) -> std::vector<Meshlet>
+{
+    std::vector<Meshlet> meshlets;
+    if(indices.size() < 3) { return meshlets; }
+
+    // vertex_tag[v] == meshlet count + 1 marks vertices already referenced by the meshlet being built
+    std::vector<u32> vertex_tag(vertices.size(), 0u);
+    u32 current_tag = 1u;
+    u32 current_vertices = 0u;
+    u32 current_first_index = 0u;
+
+    auto flush_meshlet = [&](u32 end_index)
+    {
+        meshlets.push_back(Meshlet{
+            .first_index = current_first_index,
+            .index_count = end_index - current_first_index,
+        });
+        current_first_index = end_index;
+        current_vertices = 0u;
+        current_tag++;
+    };
+
+    const u32 triangle_index_count = static_cast<u32>(indices.size() / 3) * 3;
+    for(u32 triangle = 0; triangle < triangle_index_count; triangle += 3)
+    {
+        u32 new_vertices = 0u;
+        for(u32 corner = 0; corner < 3; corner++)
+        {
+            new_vertices += vertex_tag[indices[triangle + corner]] != current_tag ? 1u : 0u;
+        }
+        // duplicate indices inside a single triangle are counted twice, which only makes the check conservative
+        u32 current_triangles = (triangle - current_first_index) / 3;
+        if(current_vertices + new_vertices > MESHLET_MAX_VERTICES || current_triangles + 1 > MESHLET_MAX_TRIANGLES)
+        {
+            flush_meshlet(triangle);
+        }
+
+        for(u32 corner = 0; corner < 3; corner++)
+        {
+            u32 & tag = vertex_tag[indices[triangle + corner]];
+            if(tag != current_tag)
+            {
+                tag = current_tag;
+                current_vertices++;
+            }
+        }
+    }
+    flush_meshlet(triangle_index_count);
+
+    for(auto & meshlet : meshlets)
+    {
+        compute_meshlet_bounds(vertices, indices, meshlet);
+    }
+    return meshlets;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "types.hpp"
+#include "scene.hpp"
+
+const u32 MESHLET_MAX_VERTICES = 64u;
+const u32 MESHLET_MAX_TRIANGLES = 124u;
+
+// Cone cutoff assigned to meshlets whose normals spread too much for the backface cone test
+const f32 MESHLET_NO_CONE_CUTOFF = 2.0f;
+
+// Contiguous range of triangles of a mesh together with its mesh space bounds
+struct Meshlet
+{
+    f32vec3 center;
+    f32 radius;
+    // the whole meshlet is backfacing when dot(normalize(cone_apex - camera_position), cone_axis) >= cone_cutoff
+    f32vec3 cone_apex;
+    f32 cone_cutoff;
+    f32vec3 cone_axis;
+    // relative to the first index of the mesh
+    u32 first_index;
+    u32 index_count;
+};
+
+// Greedily splits the triangles in index buffer order. The index buffer is expected to be optimized
+// for the vertex cache beforehand, which keeps neighbouring triangles together and the meshlets compact.
+[[nodiscard]] auto build_meshlets(std::span<const Vertex> vertices, std::span<const u32> indices) -> std::vector<Meshlet>;
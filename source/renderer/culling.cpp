@@ -0,0 +1,387 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+Frustum::Frustum(const f32mat4x4 & m_proj_view)
+{
+    auto row = [&](i32 index) -> f32vec4
+    {
+        return f32vec4(m_proj_view[0][index], m_proj_view[1][index], m_proj_view[2][index], m_proj_view[3][index]);
+    };
+
+    planes = {
+        row(3) + row(0), // left
+        row(3) - row(0), // right
+        row(3) + row(1), // bottom
+        row(3) - row(1), // top
+        row(2),          // near
+        row(3) - row(2), // far
+    };
+
+    for(auto & plane : planes)
+    {
+        plane /= glm::length(f32vec3(plane));
+    }
+
+    for(u32 plane = 0; plane < 8; plane++)
+    {
+        f32vec4 padded_plane = plane < planes.size() ? planes[plane] : f32vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        planes_x[plane] = padded_plane.x;
+        planes_y[plane] = padded_plane.y;
+        planes_z[plane] = padded_plane.z;
+        planes_w[plane] = padded_plane.w;
+    }
+}
+
+auto Frustum::is_sphere_visible(const f32vec3 & center, f32 radius) const -> bool
+{
+    for(const auto & plane : planes)
+    {
+        if(glm::dot(f32vec3(plane), center) + plane.w < -radius) { return false; }
+    }
+    return true;
+}
+
+auto Frustum::classify_aabb(const Aabb & box) const -> FrustumOverlap
+{
+    f32vec3 center = (box.min + box.max) * 0.5f;
+    f32vec3 half_extent = (box.max - box.min) * 0.5f;
+    // the box is outside when even its vertex furthest along the plane normal lies behind a plane
+    // and inside when the vertex furthest against the normal lies in front of all of them
+#ifdef CULLING_SSE
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 center_x = _mm_set1_ps(center.x);
+    const __m128 center_y = _mm_set1_ps(center.y);
+    const __m128 center_z = _mm_set1_ps(center.z);
+    const __m128 extent_x = _mm_set1_ps(half_extent.x);
+    const __m128 extent_y = _mm_set1_ps(half_extent.y);
+    const __m128 extent_z = _mm_set1_ps(half_extent.z);
+    __m128 outside = _mm_setzero_ps();
+    __m128 intersecting = _mm_setzero_ps();
+    for(u32 plane = 0; plane < 8; plane += 4)
+    {
+        __m128 normal_x = _mm_load_ps(&planes_x[plane]);
+        __m128 normal_y = _mm_load_ps(&planes_y[plane]);
+        __m128 normal_z = _mm_load_ps(&planes_z[plane]);
+        __m128 distance = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(normal_x, center_x), _mm_mul_ps(normal_y, center_y)),
+            _mm_add_ps(_mm_mul_ps(normal_z, center_z), _mm_load_ps(&planes_w[plane])));
+        __m128 radius = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, normal_x), extent_x), _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_y), extent_y)),
+            _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_z), extent_z));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+    }
+    if(_mm_movemask_ps(outside) != 0) { return FrustumOverlap::OUTSIDE; }
+    return _mm_movemask_ps(intersecting) != 0 ? FrustumOverlap::INTERSECTING : FrustumOverlap::INSIDE;
+#else
+    auto overlap = FrustumOverlap::INSIDE;
+    for(const auto & plane : planes)
+    {
+        f32 distance = glm::dot(f32vec3(plane), center) + plane.w;
+        f32 radius = glm::dot(glm::abs(f32vec3(plane)), half_extent);
+        if(distance + radius < 0.0f) { return FrustumOverlap::OUTSIDE; }
+        if(distance - radius < 0.0f) { overlap = FrustumOverlap::INTERSECTING; }
+    }
+    return overlap;
+#endif
+}
+
+const usize DEPTH_SORT_MAX_INSTANCES = 1u << 24u;
+const usize DEPTH_SORT_MAX_BUCKETS = 1u << 16u;
+
+// LSD radix sort over bytes, the histograms of all digits are built in a single pass and
+// digits every key agrees on are skipped - with a constant state field that saves the top passes
+static void radix_sort_keys(std::vector<u64> & keys, std::vector<u64> & scratch)
+{
+    const u32 DIGIT_COUNT = 8;
+    const u32 RADIX = 256;
+    std::array<std::array<u32, RADIX>, DIGIT_COUNT> histograms = {};
+    for(u64 key : keys)
+    {
+        for(u32 digit = 0; digit < DIGIT_COUNT; digit++) { histograms[digit][(key >> (digit * 8)) & 0xFF]++; }
+    }
+
+    scratch.resize(keys.size());
+    for(u32 digit = 0; digit < DIGIT_COUNT; digit++)
+    {
+        auto & histogram = histograms[digit];
+        if(histogram[(keys.front() >> (digit * 8)) & 0xFF] == keys.size()) { continue; }
+
+        u32 offset = 0;
+        for(auto & count : histogram)
+        {
+            u32 current = count;
+            count = offset;
+            offset += current;
+        }
+        for(u64 key : keys) { scratch[histogram[(key >> (digit * 8)) & 0xFF]++] = key; }
+        std::swap(keys, scratch);
+    }
+}
+
+// Meshlet culling is only worth it for a single visible instance, several instances of a mesh
+// share one instanced draw of the whole level since their visible meshlets differ. This is the only
+// place meshlets are culled, in scenes made of instanced meshes it mostly applies to unique geometry
+// such as the level itself, the GPU culling path does not cull meshlets at all
+static void cull_instance_meshlets(RendererContext & context, const CullSceneInfo & info, const Frustum & frustum,
+                                   u32 instance_idx, u32 lod_idx, u32 first_instance, CullSceneStats & stats)
+{
+    auto & render_info = context.render_info;
+    const auto & instance = render_info.instances[instance_idx];
+    const auto & mesh = render_info.meshes[instance.mesh_index];
+    const auto & lod = mesh.lods[lod_idx];
+    const auto & m_model = instance.model_transform;
+
+    f32vec3 axis_scales = f32vec3(
+        glm::length(f32vec3(m_model[0])),
+        glm::length(f32vec3(m_model[1])),
+        glm::length(f32vec3(m_model[2])));
+    f32 max_scale = glm::max(axis_scales.x, glm::max(axis_scales.y, axis_scales.z));
+    f32 min_scale = glm::min(axis_scales.x, glm::min(axis_scales.y, axis_scales.z));
+    // non uniform scale changes the normal cone angle, only the sphere test stays valid then
+    bool cone_test = context.conditionals.meshlet_cone_culling && (max_scale - min_scale) <= max_scale * 0.01f;
+
+    bool range_open = false;
+    for(u32 meshlet_idx = lod.first_meshlet; meshlet_idx < lod.first_meshlet + lod.meshlet_count; meshlet_idx++)
+    {
+        const auto & meshlet = render_info.meshlets[meshlet_idx];
+
+        f32vec3 world_center = f32vec3(m_model * f32vec4(meshlet.center, 1.0f));
+        bool visible = frustum.is_sphere_visible(world_center, meshlet.radius * max_scale);
+        if(visible && cone_test && meshlet.cone_cutoff <= 1.0f)
+        {
+            f32vec3 world_apex = f32vec3(m_model * f32vec4(meshlet.cone_apex, 1.0f));
+            f32vec3 world_axis = glm::normalize(f32vec3(m_model * f32vec4(meshlet.cone_axis, 0.0f)));
+            visible = glm::dot(glm::normalize(world_apex - info.camera_position), world_axis) < meshlet.cone_cutoff;
+        }
+
+        if(!visible)
+        {
+            range_open = false;
+            continue;
+        }
+
+        stats.drawn_triangles += meshlet.index_count / 3;
+        if(range_open)
+        {
+            render_info.visible_draws.back().index_count += meshlet.index_count;
+        } else {
+            render_info.visible_draws.push_back({
+                .mesh_index = instance.mesh_index,
+                .first_index = lod.index_buffer_offset + meshlet.first_index,
+                .index_count = meshlet.index_count,
+                .first_instance = first_instance,
+                .instance_count = 1,
+            });
+            range_open = true;
+        }
+    }
+}
+
+auto cull_scene(RendererContext & context, const CullSceneInfo & info) -> CullSceneStats
+{
+    auto & render_info = context.render_info;
+    auto & visible_instances = context.buffers.visible_instances;
+    render_info.visible_draws.clear();
+    CullSceneStats stats = {};
+
+    Frustum frustum(info.m_proj_view);
+    f32vec4 view_depth_row = f32vec4(info.m_proj_view[0][3], info.m_proj_view[1][3], info.m_proj_view[2][3], info.m_proj_view[3][3]);
+
+    // instances are bucketed by mesh and level of detail, every bucket becomes one instanced draw
+    struct VisibleInstance
+    {
+        u32 instance_index;
+        u32 bucket;
+        // view space depth of the bounds center, only used for sorting
+        f32 depth;
+    };
+    std::vector<VisibleInstance> instances;
+    std::vector<u32> bucket_offsets(render_info.meshes.size() * MAX_MESH_LODS, 0u);
+    instances.reserve(render_info.instances.size());
+
+    auto add_visible_instance = [&](u32 instance_idx)
+    {
+        const auto & instance = render_info.instances[instance_idx];
+        const auto & mesh = render_info.meshes[instance.mesh_index];
+        const auto & m_model = instance.model_transform;
+        f32vec3 world_center = f32vec3(m_model * f32vec4(mesh.bounds_center, 1.0f));
+
+        u32 lod_idx = 0;
+        if(context.conditionals.lod_selection)
+        {
+            f32 max_scale = glm::max(glm::length(f32vec3(m_model[0])), glm::max(glm::length(f32vec3(m_model[1])), glm::length(f32vec3(m_model[2]))));
+            f32 world_radius = mesh.bounds_radius * max_scale;
+            // the closest point of the bounds gives a conservative estimate of the projected error
+            f32 distance = glm::max(glm::length(world_center - info.camera_position) - world_radius, 0.1f);
+            f32 error_to_pixels = max_scale * info.lod_error_scale / distance;
+            // errors grow monotonically along the chain
+            while(lod_idx + 1 < mesh.lod_count && mesh.lods[lod_idx + 1].error * error_to_pixels <= info.lod_error_threshold)
+            {
+                lod_idx++;
+            }
+        }
+        u32 bucket = instance.mesh_index * MAX_MESH_LODS + lod_idx;
+        // w of the clip space position is the view space depth
+        f32 depth = glm::dot(view_depth_row, f32vec4(world_center, 1.0f));
+        instances.push_back({.instance_index = instance_idx, .bucket = bucket, .depth = depth});
+        bucket_offsets[bucket]++;
+    };
+
+    // subtrees entirely inside of the frustum are accepted without testing any of their nodes or instances
+    const auto & bvh = render_info.bvh;
+    struct StackEntry
+    {
+        u32 node_index;
+        bool inside;
+    };
+    std::vector<StackEntry> node_stack;
+    if(!bvh.nodes.empty()) { node_stack.push_back({.node_index = 0, .inside = false}); }
+    while(!node_stack.empty())
+    {
+        auto [node_idx, inside] = node_stack.back();
+        node_stack.pop_back();
+        const auto & node = bvh.nodes[node_idx];
+        if(!inside)
+        {
+            auto overlap = frustum.classify_aabb({.min = node.bounds_min, .max = node.bounds_max});
+            if(overlap == FrustumOverlap::OUTSIDE) { continue; }
+            inside = overlap == FrustumOverlap::INSIDE;
+        }
+
+        if(node.count == 0)
+        {
+            node_stack.push_back({.node_index = node.first + 1, .inside = inside});
+            node_stack.push_back({.node_index = node.first, .inside = inside});
+            continue;
+        }
+        for(u32 item = node.first; item < node.first + node.count; item++)
+        {
+            if(!inside && frustum.classify_aabb(bvh.item_bounds[item]) == FrustumOverlap::OUTSIDE) { continue; }
+            add_visible_instance(bvh.item_indices[item]);
+        }
+    }
+
+    std::vector<u32> bucket_counts = bucket_offsets;
+    visible_instances.resize(exclusive_prefix_sum(bucket_offsets));
+
+    // Sorting whole instances by depth would split the instanced draw of a bucket into one draw per run of its
+    // instances. Buckets are ordered front to back by their nearest instance instead, and only the instances
+    // within a bucket by their own depth, so there are exactly as many draws as without sorting
+    std::vector<u32> visible_buckets;
+    if(context.conditionals.depth_sort)
+    {
+        for(u32 bucket = 0; bucket < bucket_counts.size(); bucket++)
+        {
+            if(bucket_counts[bucket] != 0) { visible_buckets.push_back(bucket); }
+        }
+    }
+
+    // the bucket rank and the index into instances have to fit into their bits of the sort key
+    if(context.conditionals.depth_sort && instances.size() <= DEPTH_SORT_MAX_INSTANCES && visible_buckets.size() <= DEPTH_SORT_MAX_BUCKETS)
+    {
+        std::vector<f32> bucket_depths(bucket_counts.size(), std::numeric_limits<f32>::max());
+        for(const auto & instance : instances)
+        {
+            bucket_depths[instance.bucket] = glm::min(bucket_depths[instance.bucket], instance.depth);
+        }
+        std::sort(visible_buckets.begin(), visible_buckets.end(), [&](u32 first, u32 second) { return bucket_depths[first] < bucket_depths[second]; });
+        std::vector<u32> bucket_ranks(bucket_counts.size(), 0u);
+        for(u32 rank = 0; rank < visible_buckets.size(); rank++) { bucket_ranks[visible_buckets[rank]] = rank; }
+
+        // key - 8 bits pipeline state | 16 bits bucket rank | 16 bits coarse depth | 24 bits index into instances.
+        // The depth is clamped to be positive so that its upper bits order like the float, there is only the
+        // scene pipeline for now
+        const u64 pipeline_state = 0;
+        std::vector<u64> sort_keys;
+        std::vector<u64> sort_scratch;
+        sort_keys.reserve(instances.size());
+        for(u32 instance = 0; instance < instances.size(); instance++)
+        {
+            u64 bucket_rank = bucket_ranks[instances[instance].bucket];
+            u64 depth_bits = std::bit_cast<u32>(glm::max(instances[instance].depth, 0.0f)) >> 16u;
+            sort_keys.push_back((pipeline_state << 56) | (bucket_rank << 40) | (depth_bits << 24) | instance);
+        }
+        if(!sort_keys.empty()) { radix_sort_keys(sort_keys, sort_scratch); }
+
+        // every bucket is a contiguous run front to back and becomes one instanced draw
+        u32 open_bucket = std::numeric_limits<u32>::max();
+        for(u32 visible_idx = 0; visible_idx < sort_keys.size(); visible_idx++)
+        {
+            const auto & instance = instances[sort_keys[visible_idx] & 0xFFFFFF];
+            visible_instances[visible_idx] = {.instance_index = instance.instance_index};
+
+            u32 mesh_idx = instance.bucket / MAX_MESH_LODS;
+            u32 lod_idx = instance.bucket % MAX_MESH_LODS;
+            const auto & lod = render_info.meshes[mesh_idx].lods[lod_idx];
+            if(bucket_counts[instance.bucket] == 1)
+            {
+                cull_instance_meshlets(context, info, frustum, instance.instance_index, lod_idx, visible_idx, stats);
+                open_bucket = std::numeric_limits<u32>::max();
+                continue;
+            }
+
+            stats.drawn_triangles += lod.index_count / 3;
+            if(open_bucket == instance.bucket)
+            {
+                render_info.visible_draws.back().instance_count++;
+                continue;
+            }
+            render_info.visible_draws.push_back({
+                .mesh_index = mesh_idx,
+                .first_index = lod.index_buffer_offset,
+                .index_count = lod.index_count,
+                .first_instance = visible_idx,
+                .instance_count = 1,
+            });
+            open_bucket = instance.bucket;
+        }
+    }
+    else
+    {
+        std::vector<u32> bucket_cursors = bucket_offsets;
+        for(const auto & instance : instances)
+        {
+            visible_instances[bucket_cursors[instance.bucket]++] = {.instance_index = instance.instance_index};
+        }
+
+        for(u32 bucket = 0; bucket < bucket_counts.size(); bucket++)
+        {
+            if(bucket_counts[bucket] == 0) { continue; }
+
+            u32 mesh_idx = bucket / MAX_MESH_LODS;
+            u32 lod_idx = bucket % MAX_MESH_LODS;
+            if(bucket_counts[bucket] == 1)
+            {
+                u32 instance_idx = visible_instances[bucket_offsets[bucket]].instance_index;
+                cull_instance_meshlets(context, info, frustum, instance_idx, lod_idx, bucket_offsets[bucket], stats);
+                continue;
+            }
+
+            const auto & lod = render_info.meshes[mesh_idx].lods[lod_idx];
+            render_info.visible_draws.push_back({
+                .mesh_index = mesh_idx,
+                .first_index = lod.index_buffer_offset,
+                .index_count = lod.index_count,
+                .first_instance = bucket_offsets[bucket],
+                .instance_count = bucket_counts[bucket],
+            });
+            stats.drawn_triangles += static_cast<u64>(lod.index_count / 3) * bucket_counts[bucket];
+        }
+    }
+
+    stats.full_detail_triangles = render_info.full_detail_triangles;
+    stats.visible_instances = visible_instances.size();
+    stats.culled_instances = render_info.bvh.item_indices.size() - visible_instances.size();
+    stats.draw_calls = render_info.visible_draws.size();
+    context.conditionals.fill_visible_instances = !visible_instances.empty();
+    return stats;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+
+#include "../types.hpp"
+#include "renderer_context.hpp"
+
+enum struct FrustumOverlap
+{
+    OUTSIDE,
+    INTERSECTING,
+    INSIDE
+};
+
+struct Frustum
+{
+    // xyz is the plane normal pointing into the frustum, w the plane distance
+    std::array<f32vec4, 6> planes;
+    // the planes transposed so that four of them are tested at once,
+    // padded with two planes every point lies in front of
+    alignas(16) std::array<f32, 8> planes_x;
+    alignas(16) std::array<f32, 8> planes_y;
+    alignas(16) std::array<f32, 8> planes_z;
+    alignas(16) std::array<f32, 8> planes_w;
+
+    // Gribb-Hartmann plane extraction, expects zero to one depth range
+    explicit Frustum(const f32mat4x4 & m_proj_view);
+
+    [[nodiscard]] auto is_sphere_visible(const f32vec3 & center, f32 radius) const -> bool;
+    // SSE when available, INSIDE means the box does not touch any of the planes
+    [[nodiscard]] auto classify_aabb(const Aabb & box) const -> FrustumOverlap;
+};
+
+struct CullSceneInfo
+{
+    const f32mat4x4 & m_proj_view;
+    const f32vec3 camera_position;
+    // converts world space error at unit distance to pixels - viewport height / (2 * tan(fov_y / 2))
+    const f32 lod_error_scale;
+    // coarsest level whose projected error stays under this many pixels is selected
+    const f32 lod_error_threshold = 1.0f;
+};
+
+struct CullSceneStats
+{
+    u64 drawn_triangles;
+    u64 full_detail_triangles;
+    u64 visible_instances;
+    u64 culled_instances;
+    u64 draw_calls;
+};
+
+// Frustum culls the instances by walking the scene BVH, selects its level of detail from the projected simplification error
+// and groups the survivors by mesh and level into context.buffers.visible_instances. Every group fills
+// one instanced range of context.render_info.visible_draws, except groups with a single instance whose
+// meshlets additionally go through the frustum and normal cone tests, adjacent surviving meshlets
+// are merged into a single range. Groups of several instances are never culled per meshlet. With depth
+// sorting the groups are drawn front to back by their nearest instance, and the instances within a group too
+auto cull_scene(RendererContext & context, const CullSceneInfo & info) -> CullSceneStats;
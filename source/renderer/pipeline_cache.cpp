@@ -0,0 +1,415 @@
+#include "pipeline_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <variant>
+
+#include "../utils.hpp"
+
+// Bump whenever the layout of the cache files or the way the variant keys are built changes
+const u32 PIPELINE_CACHE_MAGIC = 0x43505354u; // "TSPC"
+const u32 PIPELINE_CACHE_VERSION = 1u;
+
+// followed by the variant key and then the SPIR-V words of every stage back to back
+struct PipelineCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key_size;
+    u32 stage_count;
+    u32 stage_word_counts[2];
+};
+
+// manager of the compile_parallel job running on this thread
+static thread_local daxa::PipelineManager * job_pipeline_manager = nullptr;
+
+// same lookup order as the shader compiler, the directory of the including file first and then the root paths
+static auto find_shader_source(
+    const std::vector<std::filesystem::path> & root_paths,
+    const std::filesystem::path & including_directory,
+    const std::filesystem::path & path) -> std::filesystem::path
+{
+    std::error_code error;
+    if(!including_directory.empty() && std::filesystem::exists(including_directory / path, error)) { return including_directory / path; }
+    for(const auto & root_path : root_paths)
+    {
+        if(std::filesystem::exists(root_path / path, error)) { return root_path / path; }
+    }
+    return {};
+}
+
+// Hashes the contents of the shader and of everything it includes. Conditional includes are followed
+// regardless of the defines, which at worst lets an unused header change invalidate the variant.
+static void hash_shader_sources(
+    const std::vector<std::filesystem::path> & root_paths,
+    const std::filesystem::path & including_directory,
+    const std::filesystem::path & path,
+    std::unordered_set<std::string> & visited,
+    u64 & hash)
+{
+    auto source_path = find_shader_source(root_paths, including_directory, path);
+    if(source_path.empty() || !visited.insert(source_path.lexically_normal().string()).second) { return; }
+
+    std::ifstream source_file(source_path, std::ios::binary);
+    std::string source((std::istreambuf_iterator<char>(source_file)), std::istreambuf_iterator<char>());
+    hash = hash_bytes(reinterpret_cast<const u8 *>(source.data()), source.size(), hash);
+
+    std::istringstream lines(source);
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        auto directive = line.find_first_not_of(" \t");
+        if(directive == std::string::npos || line.compare(directive, 8, "#include") != 0) { continue; }
+        auto name_begin = line.find_first_of("<\"", directive + 8);
+        if(name_begin == std::string::npos) { continue; }
+        auto name_end = line.find_first_of(">\"", name_begin + 1);
+        if(name_end == std::string::npos) { continue; }
+        hash_shader_sources(root_paths, source_path.parent_path(), line.substr(name_begin + 1, name_end - name_begin - 1), visited, hash);
+    }
+}
+
+void PipelineCache::append_shader_key(VariantKey & variant_key, const daxa::ShaderCompileInfo & info) const
+{
+    if(const auto * file = std::get_if<daxa::ShaderFile>(&info.source))
+    {
+        // an edited shader or header gets variants of its own instead of the ones compiled from the old source
+        std::vector<std::filesystem::path> root_paths = info.compile_options.root_paths;
+        root_paths.insert(root_paths.end(), shader_compile_options.root_paths.begin(), shader_compile_options.root_paths.end());
+        std::unordered_set<std::string> visited;
+        u64 source_hash = FNV_OFFSET_BASIS;
+        hash_shader_sources(root_paths, {}, file->path, visited, source_hash);
+        variant_key.key += file->path.string() + "#" + std::to_string(source_hash);
+        variant_key.sources.insert(variant_key.sources.end(), visited.begin(), visited.end());
+    }
+    for(const auto & define : info.compile_options.defines) { variant_key.key += "|" + define.name + "=" + define.value; }
+    variant_key.key += ";";
+}
+
+// the global options are part of the SPIR-V written to disk, a build with other defines must not pick it up
+static auto get_global_key(const daxa::ShaderCompileOptions & options) -> std::string
+{
+    std::string key = std::to_string(options.enable_debug_info.value_or(false));
+    for(const auto & define : options.defines) { key += "|" + define.name + "=" + define.value; }
+    return key + ";";
+}
+
+auto PipelineCache::get_variant_key(const daxa::ComputePipelineCompileInfo & info) const -> VariantKey
+{
+    VariantKey variant_key = {.key = get_global_key(shader_compile_options) + info.debug_name + ";"};
+    append_shader_key(variant_key, info.shader_info);
+    variant_key.key += std::to_string(info.push_constant_size);
+    return variant_key;
+}
+
+auto PipelineCache::get_variant_key(const daxa::RasterPipelineCompileInfo & info) const -> VariantKey
+{
+    VariantKey variant_key = {.key = get_global_key(shader_compile_options) + info.debug_name + ";"};
+    append_shader_key(variant_key, info.vertex_shader_info);
+    append_shader_key(variant_key, info.fragment_shader_info);
+    auto & key = variant_key.key;
+    for(const auto & attachment : info.color_attachments) { key += std::to_string(static_cast<i32>(attachment.format)) + ","; }
+    key += std::to_string(static_cast<i32>(info.depth_test.depth_attachment_format)) + "," +
+        std::to_string(info.depth_test.enable_depth_test) + "," +
+        std::to_string(info.depth_test.enable_depth_write) + "," +
+        std::to_string(static_cast<i32>(info.depth_test.depth_test_compare_op)) + "," +
+        std::to_string(static_cast<i32>(info.raster.primitive_topology)) + "," +
+        std::to_string(static_cast<i32>(info.raster.polygon_mode)) + "," +
+        std::to_string(info.raster.face_culling.data) + "," +
+        std::to_string(static_cast<i32>(info.raster.front_face_winding)) + "," +
+        std::to_string(info.push_constant_size);
+    return variant_key;
+}
+
+static auto get_pipeline_cache_path(const std::string & key) -> std::string
+{
+    char hash_string[17];
+    u64 key_hash = hash_bytes(reinterpret_cast<const u8 *>(key.data()), key.size());
+    snprintf(hash_string, sizeof(hash_string), "%016llx", static_cast<unsigned long long>(key_hash));
+    return std::string("pipeline_cache/") + hash_string + ".spv";
+}
+
+// returns nothing when the file does not exist, is outdated or belongs to another key hashing to the same name
+static auto load_spirv(const std::string & key, u32 stage_count) -> std::optional<std::vector<std::vector<u32>>>
+{
+    std::ifstream in(get_pipeline_cache_path(key), std::ios::binary);
+    if(!in.is_open()) { return std::nullopt; }
+
+    PipelineCacheHeader header = {};
+    in.read(reinterpret_cast<char *>(&header), sizeof(PipelineCacheHeader));
+    if(!in || header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION ||
+       header.key_size != key.size() || header.stage_count != stage_count)
+    {
+        return std::nullopt;
+    }
+    std::string stored_key(key.size(), '\0');
+    in.read(stored_key.data(), static_cast<std::streamsize>(stored_key.size()));
+    if(!in || stored_key != key) { return std::nullopt; }
+
+    std::vector<std::vector<u32>> stages(stage_count);
+    for(u32 stage = 0; stage < stage_count; stage++)
+    {
+        stages[stage].resize(header.stage_word_counts[stage]);
+        in.read(reinterpret_cast<char *>(stages[stage].data()), static_cast<std::streamsize>(stages[stage].size() * sizeof(u32)));
+        if(!in || stages[stage].empty()) { return std::nullopt; }
+    }
+    return stages;
+}
+
+static void store_spirv(const std::string & key, const std::vector<std::vector<u32>> & stages)
+{
+    std::string cache_path = get_pipeline_cache_path(key);
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), error);
+
+    PipelineCacheHeader header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .version = PIPELINE_CACHE_VERSION,
+        .key_size = key.size(),
+        .stage_count = static_cast<u32>(stages.size()),
+    };
+    for(usize stage = 0; stage < stages.size(); stage++) { header.stage_word_counts[stage] = static_cast<u32>(stages[stage].size()); }
+
+    // write into a temporary file first so that an interrupted write never leaves a corrupt cache behind,
+    // the name is unique per key which only one job compiles at a time
+    std::string tmp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if(!out.is_open())
+        {
+            DEBUG_OUT("[PipelineCache::store_spirv()] Failed to open " << tmp_path);
+            return;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(PipelineCacheHeader));
+        out.write(key.data(), static_cast<std::streamsize>(key.size()));
+        for(const auto & stage : stages)
+        {
+            out.write(reinterpret_cast<const char *>(stage.data()), static_cast<std::streamsize>(stage.size() * sizeof(u32)));
+        }
+        if(!out.good())
+        {
+            DEBUG_OUT("[PipelineCache::store_spirv()] Failed to write " << tmp_path);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp_path, cache_path, error);
+    if(error) { DEBUG_OUT("[PipelineCache::store_spirv()] Failed to rename " << tmp_path << " : " << error.message()); }
+}
+
+static auto get_spirv(const daxa::ComputePipeline & pipeline) -> std::vector<std::vector<u32>>
+{
+    return {pipeline.info().shader_info.binary};
+}
+
+static auto get_spirv(const daxa::RasterPipeline & pipeline) -> std::vector<std::vector<u32>>
+{
+    return {pipeline.info().vertex_shader_info.binary, pipeline.info().fragment_shader_info.binary};
+}
+
+static auto get_stage_count(const daxa::ComputePipelineCompileInfo &) -> u32 { return 1; }
+static auto get_stage_count(const daxa::RasterPipelineCompileInfo &) -> u32 { return 2; }
+
+void PipelineCache::init(daxa::Device device, daxa::ShaderCompileOptions shader_compile_options)
+{
+    this->device = device;
+    this->shader_compile_options = std::move(shader_compile_options);
+    add_pipeline_manager();
+}
+
+void PipelineCache::add_pipeline_manager()
+{
+    pipeline_managers.push_back(daxa::PipelineManager({
+        .device = device,
+        .shader_compile_options = shader_compile_options,
+        .debug_name = "Pipeline Compiler " + std::to_string(pipeline_managers.size()),
+    }));
+}
+
+auto PipelineCache::get_pipeline_manager() -> daxa::PipelineManager &
+{
+    return job_pipeline_manager != nullptr ? *job_pipeline_manager : pipeline_managers.front();
+}
+
+auto PipelineCache::create_pipeline(const daxa::ComputePipelineCompileInfo & info, std::vector<std::vector<u32>> && stages) -> std::shared_ptr<daxa::ComputePipeline>
+{
+    return std::make_shared<daxa::ComputePipeline>(device.create_compute_pipeline({
+        .shader_info = {.binary = std::move(stages[0])},
+        .push_constant_size = info.push_constant_size,
+        .debug_name = info.debug_name,
+    }));
+}
+
+auto PipelineCache::create_pipeline(const daxa::RasterPipelineCompileInfo & info, std::vector<std::vector<u32>> && stages) -> std::shared_ptr<daxa::RasterPipeline>
+{
+    return std::make_shared<daxa::RasterPipeline>(device.create_raster_pipeline({
+        .vertex_shader_info = {.binary = std::move(stages[0])},
+        .fragment_shader_info = {.binary = std::move(stages[1])},
+        .color_attachments = info.color_attachments,
+        .depth_test = info.depth_test,
+        .raster = info.raster,
+        .push_constant_size = info.push_constant_size,
+        .debug_name = info.debug_name,
+    }));
+}
+
+auto PipelineCache::compile_pipeline(daxa::PipelineManager & pipeline_manager, const daxa::ComputePipelineCompileInfo & info) -> std::shared_ptr<daxa::ComputePipeline>
+{
+    auto result = pipeline_manager.add_compute_pipeline(info);
+    if(!result.is_ok())
+    {
+        DEBUG_OUT("[PipelineCache::compile_pipeline()] " << result.to_string());
+        return nullptr;
+    }
+    return result.value();
+}
+
+auto PipelineCache::compile_pipeline(daxa::PipelineManager & pipeline_manager, const daxa::RasterPipelineCompileInfo & info) -> std::shared_ptr<daxa::RasterPipeline>
+{
+    auto result = pipeline_manager.add_raster_pipeline(info);
+    if(!result.is_ok())
+    {
+        DEBUG_OUT("[PipelineCache::compile_pipeline()] " << result.to_string());
+        return nullptr;
+    }
+    return result.value();
+}
+
+// only called with variants_mutex held
+void PipelineCache::watch_sources(const std::vector<std::string> & sources)
+{
+    for(const auto & source : sources)
+    {
+        if(source_write_times.contains(source)) { continue; }
+        std::error_code error;
+        auto write_time = std::filesystem::last_write_time(source, error);
+        if(!error) { source_write_times.emplace(source, write_time); }
+    }
+}
+
+template<typename CompileInfo, typename Pipeline>
+auto PipelineCache::get_pipeline(VariantMap<CompileInfo, Pipeline> & variants, const CompileInfo & info) -> std::shared_ptr<Pipeline>
+{
+    auto variant_key = get_variant_key(info);
+    {
+        std::lock_guard lock(variants_mutex);
+        auto variant = variants.find(variant_key.key);
+        if(variant != variants.end()) { return variant->second.pipeline; }
+    }
+
+    std::shared_ptr<Pipeline> pipeline = nullptr;
+    if(auto stages = load_spirv(variant_key.key, get_stage_count(info)); stages.has_value())
+    {
+        pipeline = create_pipeline(info, std::move(stages.value()));
+    } else {
+        pipeline = compile_pipeline(get_pipeline_manager(), info);
+        if(pipeline == nullptr) { return nullptr; }
+        store_spirv(variant_key.key, get_spirv(*pipeline));
+    }
+
+    std::lock_guard lock(variants_mutex);
+    watch_sources(variant_key.sources);
+    // another job may have created the same variant in the meantime, its pipeline is kept
+    return variants.try_emplace(variant_key.key, Variant<CompileInfo, Pipeline>{
+        .compile_info = info,
+        .pipeline = pipeline,
+        .sources = std::move(variant_key.sources),
+    }).first->second.pipeline;
+}
+
+auto PipelineCache::get_compute_pipeline(const daxa::ComputePipelineCompileInfo & info) -> std::shared_ptr<daxa::ComputePipeline>
+{
+    return get_pipeline(compute_variants, info);
+}
+
+auto PipelineCache::get_raster_pipeline(const daxa::RasterPipelineCompileInfo & info) -> std::shared_ptr<daxa::RasterPipeline>
+{
+    return get_pipeline(raster_variants, info);
+}
+
+void PipelineCache::compile_parallel(JobSystem & job_system, const std::vector<std::function<void()>> & jobs)
+{
+    // created up front, the vector must not reallocate while the jobs use its managers
+    usize first_manager = pipeline_managers.size();
+    for(usize job = 0; job < jobs.size(); job++) { add_pipeline_manager(); }
+
+    job_system.parallel_for(jobs.size(), 1, [&](usize begin, usize end)
+    {
+        for(usize job = begin; job < end; job++)
+        {
+            job_pipeline_manager = &pipeline_managers[first_manager + job];
+            jobs[job]();
+            job_pipeline_manager = nullptr;
+        }
+    });
+    // the pipelines outlive the managers that compiled them, hot reloading goes through the variants
+    pipeline_managers.erase(pipeline_managers.begin() + static_cast<std::ptrdiff_t>(first_manager), pipeline_managers.end());
+}
+
+// only called with variants_mutex held
+template<typename CompileInfo, typename Pipeline>
+void PipelineCache::reload_variants(VariantMap<CompileInfo, Pipeline> & variants, const std::unordered_set<std::string> & changed_sources)
+{
+    std::vector<std::string> changed_keys;
+    for(const auto & [key, variant] : variants)
+    {
+        bool changed = std::any_of(variant.sources.begin(), variant.sources.end(), [&](const std::string & source) { return changed_sources.contains(source); });
+        if(changed) { changed_keys.push_back(key); }
+    }
+
+    for(const auto & key : changed_keys)
+    {
+        auto variant = variants.extract(key);
+        auto & compile_info = variant.mapped().compile_info;
+        auto new_key = get_variant_key(compile_info);
+        // saved without any change of the contents
+        if(new_key.key == key)
+        {
+            variants.insert(std::move(variant));
+            continue;
+        }
+
+        auto existing = variants.find(new_key.key);
+        if(existing != variants.end())
+        {
+            // changed back to contents compiled before, the pipelines handed out so far are updated in place
+            *variant.mapped().pipeline = *existing->second.pipeline;
+            continue;
+        }
+
+        auto pipeline = compile_pipeline(pipeline_managers.front(), compile_info);
+        if(pipeline == nullptr)
+        {
+            // the previous pipeline stays in use until the sources compile again
+            variants.insert(std::move(variant));
+            continue;
+        }
+        store_spirv(new_key.key, get_spirv(*pipeline));
+        *variant.mapped().pipeline = *pipeline;
+        variant.mapped().sources = std::move(new_key.sources);
+        watch_sources(variant.mapped().sources);
+        variant.key() = new_key.key;
+        variants.insert(std::move(variant));
+        DEBUG_OUT("[PipelineCache::reload_changed()] Recompiled " << compile_info.debug_name);
+    }
+}
+
+void PipelineCache::reload_changed()
+{
+    std::lock_guard lock(variants_mutex);
+    std::unordered_set<std::string> changed_sources;
+    for(auto & [source, write_time] : source_write_times)
+    {
+        std::error_code error;
+        auto current_write_time = std::filesystem::last_write_time(source, error);
+        if(error || current_write_time == write_time) { continue; }
+        write_time = current_write_time;
+        changed_sources.insert(source);
+    }
+    if(changed_sources.empty()) { return; }
+
+    reload_variants(compute_variants, changed_sources);
+    reload_variants(raster_variants, changed_sources);
+}
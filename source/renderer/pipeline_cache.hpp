@@ -0,0 +1,80 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/pipeline_manager.hpp>
+
+#include "../types.hpp"
+#include "../job_system.hpp"
+
+// Every pipeline variant compiled so far keyed by its compile info and the contents of its shader sources, switching
+// a define back to a previous value reuses the pipeline compiled for it instead of compiling it again. The SPIR-V of
+// every variant is also written to disk under the hash of its key, so a later run creates the pipeline straight from
+// it without compiling any GLSL. Variants are recompiled and re-keyed when one of their sources changes on disk.
+struct PipelineCache
+{
+    void init(daxa::Device device, daxa::ShaderCompileOptions shader_compile_options);
+
+    // both return nullptr when the pipeline failed to compile, the error is logged
+    [[nodiscard]] auto get_compute_pipeline(const daxa::ComputePipelineCompileInfo & info) -> std::shared_ptr<daxa::ComputePipeline>;
+    [[nodiscard]] auto get_raster_pipeline(const daxa::RasterPipelineCompileInfo & info) -> std::shared_ptr<daxa::RasterPipeline>;
+    // Runs the jobs on the job system and returns once all of them are done. Every job gets a pipeline manager
+    // of its own, so the pipelines requested from inside of different jobs compile concurrently.
+    void compile_parallel(JobSystem & job_system, const std::vector<std::function<void()>> & jobs);
+    // Recompiles the variants whose shader or any header it includes changed on disk, called once per frame.
+    // Every source file is polled once no matter how many variants were compiled from it
+    void reload_changed();
+
+    private:
+        template<typename CompileInfo, typename Pipeline>
+        struct Variant
+        {
+            CompileInfo compile_info;
+            std::shared_ptr<Pipeline> pipeline;
+            // every file the variant was compiled from, the shader itself and everything it includes
+            std::vector<std::string> sources;
+        };
+        template<typename CompileInfo, typename Pipeline>
+        using VariantMap = std::unordered_map<std::string, Variant<CompileInfo, Pipeline>>;
+
+        struct VariantKey
+        {
+            std::string key;
+            std::vector<std::string> sources;
+        };
+
+        daxa::Device device;
+        daxa::ShaderCompileOptions shader_compile_options;
+        // the first one compiles everything requested outside of compile_parallel, the others only live as long as it runs
+        std::vector<daxa::PipelineManager> pipeline_managers;
+
+        std::mutex variants_mutex;
+        VariantMap<daxa::ComputePipelineCompileInfo, daxa::ComputePipeline> compute_variants;
+        VariantMap<daxa::RasterPipelineCompileInfo, daxa::RasterPipeline> raster_variants;
+        // last seen modification time of every source file of the variants
+        std::unordered_map<std::string, std::filesystem::file_time_type> source_write_times;
+
+        void append_shader_key(VariantKey & variant_key, const daxa::ShaderCompileInfo & info) const;
+        [[nodiscard]] auto get_variant_key(const daxa::ComputePipelineCompileInfo & info) const -> VariantKey;
+        [[nodiscard]] auto get_variant_key(const daxa::RasterPipelineCompileInfo & info) const -> VariantKey;
+        [[nodiscard]] auto create_pipeline(const daxa::ComputePipelineCompileInfo & info, std::vector<std::vector<u32>> && stages) -> std::shared_ptr<daxa::ComputePipeline>;
+        [[nodiscard]] auto create_pipeline(const daxa::RasterPipelineCompileInfo & info, std::vector<std::vector<u32>> && stages) -> std::shared_ptr<daxa::RasterPipeline>;
+        [[nodiscard]] auto compile_pipeline(daxa::PipelineManager & pipeline_manager, const daxa::ComputePipelineCompileInfo & info) -> std::shared_ptr<daxa::ComputePipeline>;
+        [[nodiscard]] auto compile_pipeline(daxa::PipelineManager & pipeline_manager, const daxa::RasterPipelineCompileInfo & info) -> std::shared_ptr<daxa::RasterPipeline>;
+        template<typename CompileInfo, typename Pipeline>
+        [[nodiscard]] auto get_pipeline(VariantMap<CompileInfo, Pipeline> & variants, const CompileInfo & info) -> std::shared_ptr<Pipeline>;
+        template<typename CompileInfo, typename Pipeline>
+        void reload_variants(VariantMap<CompileInfo, Pipeline> & variants, const std::unordered_set<std::string> & changed_sources);
+        void watch_sources(const std::vector<std::string> & sources);
+        [[nodiscard]] auto get_pipeline_manager() -> daxa::PipelineManager &;
+        void add_pipeline_manager();
+};
@@ -1,36 +1,76 @@
 #include "renderer.hpp"
 
-Renderer::Renderer(const AppWindow & window) :
-    context {.vulkan_context = daxa::create_context({.enable_validation = true})}
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "../scene_cache.hpp"
+#include "culling.hpp"
+
+Renderer::Renderer(const AppWindow & window, JobSystem & job_system) :
+    context {
+        .vulkan_context = daxa::create_context({.enable_validation = true}),
+        .job_system = &job_system
+    }
 {
     context.device = context.vulkan_context.create_device({.debug_name = "Daxa device"});
+    daxa::ImageUsageFlags swapchain_usage = 
+        daxa::ImageUsageFlagBits::TRANSFER_DST |
+        daxa::ImageUsageFlagBits::TRANSFER_SRC |
+        daxa::ImageUsageFlagBits::COLOR_ATTACHMENT |
+        daxa::ImageUsageFlagBits::SHADER_READ_ONLY;
+#if defined(STORAGE_SWAPCHAIN)
+    // sRGB formats can not be stored to from a shader, the TAA pass encodes the output itself instead
+    swapchain_usage |= daxa::ImageUsageFlagBits::SHADER_READ_WRITE;
+    auto surface_format_selector = [](daxa::Format format) -> i32
+    {
+        switch(format)
+        {
+            case daxa::Format::R8G8B8A8_UNORM: return 100;
+            case daxa::Format::B8G8R8A8_UNORM: return 90;
+            default: return 0;
+        }
+    };
+#else
+    auto surface_format_selector = daxa::default_format_score;
+#endif
     context.swapchain = context.device.create_swapchain({ 
         .native_window = window.get_native_handle(),
         .native_window_platform = daxa::NativeWindowPlatform::XLIB_API,
+        .surface_format_selector = surface_format_selector,
         .present_mode = daxa::PresentMode::TRIPLE_BUFFER_WAIT_FOR_VBLANK,
-        .image_usage = 
-            daxa::ImageUsageFlagBits::TRANSFER_DST |
-            daxa::ImageUsageFlagBits::TRANSFER_SRC |
-            daxa::ImageUsageFlagBits::COLOR_ATTACHMENT |
-            daxa::ImageUsageFlagBits::SHADER_READ_ONLY,
+        .image_usage = swapchain_usage,
+        .max_allowed_frames_in_flight = MAX_FRAMES_IN_FLIGHT,
         .debug_name = "Swapchain",
     });
-
-    context.pipeline_manager = daxa::PipelineManager({
-        .device = context.device,
-        .shader_compile_options = {
-            .root_paths = {
-                DAXA_SHADER_INCLUDE_DIR,
-                "source/rendering_backend",
-                "source/rendering_backend/shaders",
-                "shaders",
-                "shared"
-            },
-            .language = daxa::ShaderLanguage::GLSL,
-            .enable_debug_info = true
+#if defined(STORAGE_SWAPCHAIN)
+    auto swapchain_format = context.swapchain.get_format();
+    context.storage_swapchain = swapchain_format == daxa::Format::R8G8B8A8_UNORM || swapchain_format == daxa::Format::B8G8R8A8_UNORM;
+    if(!context.storage_swapchain) { DEBUG_OUT("[Renderer::Renderer()] Surface has no UNORM format, falling back to the tonemap pass"); }
+#endif
+
+    daxa::ShaderCompileOptions shader_compile_options = {
+        .root_paths = {
+            DAXA_SHADER_INCLUDE_DIR,
+            "source/rendering_backend",
+            "source/rendering_backend/shaders",
+            "shaders",
+            "shared"
         },
-        .debug_name = "Pipeline Compiler",
-    });
+        .language = daxa::ShaderLanguage::GLSL,
+    };
+    // only needed for shader debugging, it slows down every compile
+#if defined(LOG_DEBUG)
+    shader_compile_options.enable_debug_info = true;
+#endif
+    // shared.inl has to see the same vertex layout on both sides
+#if defined(COMPACT_VERTICES)
+    shader_compile_options.defines.push_back({"COMPACT_VERTICES", ""});
+#endif
+
+    context.pipeline_cache.init(context.device, shader_compile_options);
 
     context.timestamps = context.device.create_timeline_query_pool({
         .query_count = 4,
@@ -45,18 +85,88 @@ Renderer::Renderer(const AppWindow & window) :
     });
     context.offscreen_format = daxa::Format::R16G16B16A16_SFLOAT;
     context.velocity_format = daxa::Format::R16G16_SFLOAT;
-    create_resolution_dependent_resources();
-
-    context.pipelines.p_draw_scene = context.pipeline_manager.add_raster_pipeline(get_draw_scene_pipeline(context)).value();
-    context.pipelines.p_draw_debug_lights = context.pipeline_manager.add_raster_pipeline(get_draw_debug_lights_pipeline(context)).value();
-    context.pipelines.p_taa_pass = context.pipeline_manager.add_compute_pipeline(get_taa_pass_pipeline(context)).value();
-    context.pipelines.p_tonemap_pass = context.pipeline_manager.add_raster_pipeline(get_tonemap_pass_pipeline(context)).value();
+    create_resolution_dependent_resources(true);
+
+    // every job writes its own pipelines, the shader compilation dominates the startup time
+    auto & pipelines = context.pipelines;
+    auto & cache = context.pipeline_cache;
+    std::vector<std::function<void()>> pipeline_jobs = {
+        [&]{ pipelines.p_cull_scene = cache.get_compute_pipeline(get_cull_scene_pipeline(context)); },
+        [&]{ pipelines.p_build_hiz = cache.get_compute_pipeline(get_build_hiz_pipeline(context)); },
+        [&]{ pipelines.p_resample = cache.get_compute_pipeline(get_resample_pipeline(context)); },
+        [&]{ pipelines.p_image_diff = cache.get_compute_pipeline(get_image_diff_pipeline(context)); },
+        [&]{ pipelines.p_update_instance_transforms = cache.get_compute_pipeline(get_update_instance_transforms_pipeline(context)); },
+        [&]{ pipelines.p_draw_scene = cache.get_raster_pipeline(get_draw_scene_pipeline(context)); },
+        [&]{ pipelines.p_draw_scene_depth = cache.get_raster_pipeline(get_draw_scene_pipeline(context, ScenePipeline::DEPTH_ONLY)); },
+        [&]{ pipelines.p_shade_scene = cache.get_raster_pipeline(get_draw_scene_pipeline(context, ScenePipeline::SHADE)); },
+        [&]{ pipelines.p_draw_debug_lights = cache.get_raster_pipeline(get_draw_debug_lights_pipeline(context)); },
+        [&]{ create_taa_pipelines(); },
+    };
+    if(!context.storage_swapchain)
+    {
+        pipeline_jobs.push_back([&]{ pipelines.p_tonemap_pass = cache.get_raster_pipeline(get_tonemap_pass_pipeline(context)); });
+    }
+    cache.compile_parallel(job_system, pipeline_jobs);
 
     context.buffers.transforms_buffer.gpu_buffer = context.device.create_buffer({
         .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
         .size = sizeof(TransformData),
         .debug_name = "transform info"
     });
+    // fixed resolution, so unlike the depth image it survives resizes
+    context.hiz_image = context.device.create_image({
+        .format = daxa::Format::R32_SFLOAT,
+        .aspect = daxa::ImageAspectFlagBits::COLOR,
+        .size = {HIZ_WIDTH, HIZ_HEIGHT, 1},
+        .mip_level_count = HIZ_MIP_COUNT,
+        .usage = daxa::ImageUsageFlagBits::SHADER_READ_ONLY | daxa::ImageUsageFlagBits::SHADER_READ_WRITE,
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .debug_name = "hiz image"
+    });
+    for(u32 mip = 0; mip < HIZ_MIP_COUNT; mip++)
+    {
+        context.hiz_mip_views[mip] = context.device.create_image_view({
+            .type = daxa::ImageViewType::REGULAR_2D,
+            .format = daxa::Format::R32_SFLOAT,
+            .image = context.hiz_image,
+            .slice = {.base_mip_level = mip, .level_count = 1},
+            .debug_name = "hiz mip view"
+        });
+    }
+
+    context.buffers.draw_count_readback = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+        .size = sizeof(SceneDrawCount) * UploadRing::SEGMENT_COUNT,
+        .debug_name = "draw count readback"
+    });
+    memset(context.device.get_host_address_as<SceneDrawCount>(context.buffers.draw_count_readback), 0, sizeof(SceneDrawCount) * UploadRing::SEGMENT_COUNT);
+    context.buffers.fragment_count = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = sizeof(SceneFragmentCount),
+        .debug_name = "fragment count"
+    });
+    context.buffers.fragment_count_readback = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+        .size = sizeof(SceneFragmentCount) * UploadRing::SEGMENT_COUNT,
+        .debug_name = "fragment count readback"
+    });
+    memset(context.device.get_host_address_as<SceneFragmentCount>(context.buffers.fragment_count_readback), 0, sizeof(SceneFragmentCount) * UploadRing::SEGMENT_COUNT);
+    context.buffers.taa_precision_diff_readback = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+        .size = sizeof(TAAPrecisionDiff) * UploadRing::SEGMENT_COUNT,
+        .debug_name = "taa precision diff readback"
+    });
+    memset(context.device.get_host_address_as<TAAPrecisionDiff>(context.buffers.taa_precision_diff_readback), 0, sizeof(TAAPrecisionDiff) * UploadRing::SEGMENT_COUNT);
+    context.buffers.taa_tile_dispatches = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = sizeof(TAATileDispatch) * TAA_TILE_CLASS_COUNT,
+        .debug_name = "taa tile dispatches"
+    });
+    // a scene upload may take the budget of a whole segment, per frame data always finds space next to it
+    context.upload_ring = create_upload_ring(context.device, {
+        .segment_size = 16u * 1024u * 1024u,
+        .frame_budget = 8u * 1024u * 1024u
+    });
 
     ImGui::CreateContext();
     ImGui_ImplGlfw_InitForVulkan(window.get_glfw_window_handle(), true);
@@ -69,56 +179,64 @@ Renderer::Renderer(const AppWindow & window) :
     create_main_task();
 }
 
-void Renderer::create_resolution_dependent_resources()
+// the controller aims this far below the budget so that spikes still fit into it
+const f32 DYNAMIC_RESOLUTION_HEADROOM = 0.9f;
+const f32 DYNAMIC_RESOLUTION_STEP = 0.05f;
+const u32 DYNAMIC_RESOLUTION_UPSCALE_FRAMES = 30;
+const u32 DYNAMIC_RESOLUTION_SETTLE_FRAMES = 4;
+
+void Renderer::create_resolution_dependent_resources(bool output_resolution)
 {
     auto extent = context.swapchain.get_surface_extent();
+    context.render_extent = glm::max(u32vec2(glm::round(f32vec2(extent.x, extent.y) * context.render_scale)), u32vec2(1u));
+    auto render_extent = context.render_extent;
 
-    if(context.device.is_id_valid((context.main_task_list.prev_velocity_image)))
-    {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_prev_velocity_image, context.main_task_list.prev_velocity_image);
-        context.device.destroy_image(context.main_task_list.prev_velocity_image);
-    }
-
-    if(context.device.is_id_valid((context.main_task_list.velocity_image)))
-    {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_velocity_image, context.main_task_list.velocity_image);
-        context.device.destroy_image(context.main_task_list.velocity_image);
-    }
-
-    if(context.device.is_id_valid((context.main_task_list.accumulation_image)))
+    // the histories are only released from the task list, recreate_render_targets resamples and destroys them
+    auto release_image = [&](daxa::TaskImageId task_image, daxa::ImageId image, bool destroy)
     {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_accumulation_image, context.main_task_list.accumulation_image);
-        context.device.destroy_image(context.main_task_list.accumulation_image);
-    }
-
-    if(context.device.is_id_valid((context.main_task_list.offscreen_image)))
-    {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_offscreen_image, context.main_task_list.offscreen_image);
-        context.device.destroy_image(context.main_task_list.offscreen_image);
-    }
-
-    if(context.device.is_id_valid((context.offscreen_copy_image)))
+        if(!context.device.is_id_valid(image)) { return; }
+        context.main_task_list.task_list.remove_runtime_image(task_image, image);
+        if(destroy) { context.device.destroy_image(image); }
+    };
+    release_image(context.main_task_list.images.t_prev_velocity_image, context.main_task_list.prev_velocity_image, false);
+    release_image(context.main_task_list.images.t_velocity_image, context.main_task_list.velocity_image, true);
+    release_image(context.main_task_list.images.t_scene_color_image, context.scene_color_image, true);
+    release_image(context.main_task_list.images.t_depth_image, context.depth_image, true);
+    if(output_resolution)
     {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_offscreen_copy_image, context.offscreen_copy_image);
-        context.device.destroy_image(context.offscreen_copy_image);
-    }
+        release_image(context.main_task_list.images.t_accumulation_image, context.main_task_list.accumulation_image, false);
+        release_image(context.main_task_list.images.t_offscreen_image, context.main_task_list.offscreen_image, true);
+        release_image(context.main_task_list.images.t_taa_reference_image, context.taa_reference_image, true);
 
-    if(context.device.is_id_valid((context.depth_image)))
-    {
-        context.main_task_list.task_list.remove_runtime_image(
-            context.main_task_list.images.t_depth_image, context.depth_image);
-        context.device.destroy_image(context.depth_image);
+        for(auto [task_buffer, buffer] : {
+            std::pair{context.main_task_list.buffers.t_taa_tiles, &context.buffers.taa_tiles},
+            std::pair{context.main_task_list.buffers.t_taa_tile_states, &context.buffers.taa_tile_states}})
+        {
+            if(!context.device.is_id_valid(*buffer)) { continue; }
+            context.main_task_list.task_list.remove_runtime_buffer(task_buffer, *buffer);
+            context.device.destroy_buffer(*buffer);
+        }
+        // sized for the smallest tile size the resolve supports
+        const u32 MIN_TAA_TILE_SIZE = 8;
+        u32 tile_count = ((extent.x + MIN_TAA_TILE_SIZE - 1) / MIN_TAA_TILE_SIZE) * ((extent.y + MIN_TAA_TILE_SIZE - 1) / MIN_TAA_TILE_SIZE);
+        context.taa_tile_capacity = tile_count;
+        context.buffers.taa_tiles = context.device.create_buffer({
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .size = static_cast<u32>(sizeof(TAATile) * tile_count * TAA_TILE_CLASS_COUNT),
+            .debug_name = "taa tiles"
+        });
+        context.buffers.taa_tile_states = context.device.create_buffer({
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .size = static_cast<u32>(sizeof(TAATileState) * tile_count),
+            .debug_name = "taa tile states"
+        });
+        context.conditionals.reset_taa_tiles = true;
     }
 
     context.depth_image = context.device.create_image({
         .format = daxa::Format::D32_SFLOAT,
         .aspect = daxa::ImageAspectFlagBits::DEPTH,
-        .size   = {extent.x, extent.y, 1},
+        .size   = {render_extent.x, render_extent.y, 1},
         .usage  = 
             daxa::ImageUsageFlagBits::DEPTH_STENCIL_ATTACHMENT |
             daxa::ImageUsageFlagBits::SHADER_READ_ONLY,
@@ -132,10 +250,12 @@ void Renderer::create_resolution_dependent_resources()
         daxa::ImageUsageFlagBits::COLOR_ATTACHMENT |
         daxa::ImageUsageFlagBits::SHADER_READ_WRITE;
 
+    // TAA reconstructs the camera motion from depth instead, the images only remain as placeholders for the task list
+    auto velocity_extent = context.conditionals.depth_velocity ? u32vec2(1u) : render_extent;
     context.velocity_image_1 = context.device.create_image({
         .format = context.velocity_format,
         .aspect = daxa::ImageAspectFlagBits::COLOR,
-        .size = {extent.x, extent.y, 1},
+        .size = {velocity_extent.x, velocity_extent.y, 1},
         .usage = attachment_usage,
         .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
         .debug_name = "velocity image 2"
@@ -144,42 +264,60 @@ void Renderer::create_resolution_dependent_resources()
     context.velocity_image_2 = context.device.create_image({
         .format = context.velocity_format,
         .aspect = daxa::ImageAspectFlagBits::COLOR,
-        .size = {extent.x, extent.y, 1},
+        .size = {velocity_extent.x, velocity_extent.y, 1},
         .usage = attachment_usage,
         .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
         .debug_name = "velocity image 1"
     });
 
-    context.offscreen_image_1 = context.device.create_image({
-        .format = context.offscreen_format,
-        .aspect = daxa::ImageAspectFlagBits::COLOR,
-        .size = {extent.x, extent.y, 1},
-        .usage = attachment_usage,
-        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .debug_name = "offscreen image 1"
-    });
+    // the history is only ever written by the TAA resolve, never rendered to
+    daxa::ImageUsageFlags history_usage = 
+        daxa::ImageUsageFlagBits::SHADER_READ_ONLY |
+        daxa::ImageUsageFlagBits::SHADER_READ_WRITE;
 
-    context.offscreen_image_2 = context.device.create_image({
-        .format = context.offscreen_format,
-        .aspect = daxa::ImageAspectFlagBits::COLOR,
-        .size = {extent.x, extent.y, 1},
-        .usage = attachment_usage,
-        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .debug_name = "offscreen image 2"
-    });
+    if(output_resolution)
+    {
+        context.offscreen_image_1 = context.device.create_image({
+            .format = context.offscreen_format,
+            .aspect = daxa::ImageAspectFlagBits::COLOR,
+            .size = {extent.x, extent.y, 1},
+            .usage = history_usage,
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .debug_name = "offscreen image 1"
+        });
+
+        context.offscreen_image_2 = context.device.create_image({
+            .format = context.offscreen_format,
+            .aspect = daxa::ImageAspectFlagBits::COLOR,
+            .size = {extent.x, extent.y, 1},
+            .usage = history_usage,
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .debug_name = "offscreen image 2"
+        });
+
+        context.main_task_list.offscreen_image = context.offscreen_image_1;
+        context.main_task_list.accumulation_image = context.offscreen_image_2;
+
+        auto reference_extent = context.conditionals.compare_taa_precision ? u32vec2(extent.x, extent.y) : u32vec2(1u);
+        context.taa_reference_image = context.device.create_image({
+            .format = context.offscreen_format,
+            .aspect = daxa::ImageAspectFlagBits::COLOR,
+            .size = {reference_extent.x, reference_extent.y, 1},
+            .usage = history_usage,
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .debug_name = "taa reference image"
+        });
+    }
 
-    context.offscreen_copy_image = context.device.create_image({
+    context.scene_color_image = context.device.create_image({
         .format = context.offscreen_format,
         .aspect = daxa::ImageAspectFlagBits::COLOR,
-        .size = {extent.x, extent.y, 1},
+        .size = {render_extent.x, render_extent.y, 1},
         .usage = attachment_usage,
         .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .debug_name = "offscreen copy"
+        .debug_name = "scene color image"
     });
 
-    context.main_task_list.offscreen_image = context.offscreen_image_1;
-    context.main_task_list.accumulation_image = context.offscreen_image_2;
-
     context.main_task_list.velocity_image = context.velocity_image_1;
     context.main_task_list.prev_velocity_image = context.velocity_image_2;
 }
@@ -258,19 +396,33 @@ void Renderer::create_main_task()
             context.main_task_list.accumulation_image);
 
 
-    context.main_task_list.images.t_offscreen_copy_image = 
+    context.main_task_list.images.t_taa_reference_image = 
+        context.main_task_list.task_list.create_task_image(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .initial_layout = daxa::ImageLayout::UNDEFINED,
+            .swapchain_image = false,
+            .debug_name = "t_taa_reference_image"
+        }
+    );
+
+    context.main_task_list.task_list.add_runtime_image(
+        context.main_task_list.images.t_taa_reference_image,
+        context.taa_reference_image);
+
+    context.main_task_list.images.t_scene_color_image = 
         context.main_task_list.task_list.create_task_image(
         {
             .initial_access = daxa::AccessConsts::NONE,
             .initial_layout = daxa::ImageLayout::UNDEFINED,
             .swapchain_image = false,
-            .debug_name = "t_offscreen_copy_image"
+            .debug_name = "t_scene_color_image"
         }
     );
 
     context.main_task_list.task_list.add_runtime_image(
-        context.main_task_list.images.t_offscreen_copy_image,
-        context.offscreen_copy_image);
+        context.main_task_list.images.t_scene_color_image,
+        context.scene_color_image);
 
     context.main_task_list.images.t_depth_image = 
         context.main_task_list.task_list.create_task_image(
@@ -286,6 +438,20 @@ void Renderer::create_main_task()
         context.main_task_list.images.t_depth_image,
         context.depth_image);
 
+    context.main_task_list.images.t_hiz_image = 
+        context.main_task_list.task_list.create_task_image(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .initial_layout = daxa::ImageLayout::UNDEFINED,
+            .swapchain_image = false,
+            .debug_name = "t_hiz_image"
+        }
+    );
+
+    context.main_task_list.task_list.add_runtime_image(
+        context.main_task_list.images.t_hiz_image,
+        context.hiz_image);
+
     #pragma region camera_transforms
     context.main_task_list.buffers.t_transform_data = 
         context.main_task_list.task_list.create_task_buffer(
@@ -299,6 +465,50 @@ void Renderer::create_main_task()
         context.buffers.transforms_buffer.gpu_buffer);
     #pragma endregion camera_transforms
 
+    context.main_task_list.buffers.t_fragment_count = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_fragment_count"
+        }
+    );
+    context.main_task_list.task_list.add_runtime_buffer(
+        context.main_task_list.buffers.t_fragment_count,
+        context.buffers.fragment_count);
+
+    context.main_task_list.buffers.t_taa_tile_dispatches = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_taa_tile_dispatches"
+        }
+    );
+    context.main_task_list.task_list.add_runtime_buffer(
+        context.main_task_list.buffers.t_taa_tile_dispatches,
+        context.buffers.taa_tile_dispatches);
+
+    context.main_task_list.buffers.t_taa_tiles = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_taa_tiles"
+        }
+    );
+    context.main_task_list.task_list.add_runtime_buffer(
+        context.main_task_list.buffers.t_taa_tiles,
+        context.buffers.taa_tiles);
+
+    context.main_task_list.buffers.t_taa_tile_states = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_taa_tile_states"
+        }
+    );
+    context.main_task_list.task_list.add_runtime_buffer(
+        context.main_task_list.buffers.t_taa_tile_states,
+        context.buffers.taa_tile_states);
+
     context.main_task_list.buffers.t_scene_vertices = 
         context.main_task_list.task_list.create_task_buffer(
         {
@@ -323,12 +533,105 @@ void Renderer::create_main_task()
         }
     );
 
+    context.main_task_list.buffers.t_scene_instances = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_scene_instances"
+        }
+    );
+
+    context.main_task_list.buffers.t_instance_transforms = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_instance_transforms"
+        }
+    );
+
+    context.main_task_list.buffers.t_visible_instances = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_visible_instances"
+        }
+    );
+
+    context.main_task_list.buffers.t_scene_meshes = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_scene_meshes"
+        }
+    );
+
+    context.main_task_list.buffers.t_scene_draws = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_scene_draws"
+        }
+    );
+
+    context.main_task_list.buffers.t_draw_commands = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_draw_commands"
+        }
+    );
+
+    context.main_task_list.buffers.t_draw_count = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_draw_count"
+        }
+    );
+
+    context.main_task_list.buffers.t_occluded_instances = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_occluded_instances"
+        }
+    );
+
+    context.main_task_list.buffers.t_static_draw_commands = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_static_draw_commands"
+        }
+    );
+
+    context.main_task_list.buffers.t_static_visible_instances = 
+        context.main_task_list.task_list.create_task_buffer(
+        {
+            .initial_access = daxa::AccessConsts::NONE,
+            .debug_name = "t_static_visible_instances"
+        }
+    );
+
     task_fill_buffers(context);
+    task_update_instance_transforms(context);
     task_init_accumulation_image(context);
-    task_draw_scene(context);
+    // two phase occlusion culling - draw what was visible against the previous depth, rebuild the pyramid
+    // from that depth, draw what turned out visible against it and rebuild the pyramid for the next frame
+    task_cull_scene(context, CULL_PASS_EARLY);
+    task_draw_scene(context, ScenePass::EARLY);
+    task_build_hiz(context);
+    task_cull_scene(context, CULL_PASS_LATE);
+    task_draw_scene(context, ScenePass::LATE);
+    task_draw_scene(context, ScenePass::SHADE);
+    task_build_hiz(context);
+    task_read_back_statistics(context);
     task_draw_debug_ligts(context);
+    task_classify_taa_tiles(context);
     task_taa_pass(context);
-    task_tonemap_pass(context);
+    // otherwise the resolve already wrote the tonemapped output into the swapchain
+    if(!context.storage_swapchain) { task_tonemap_pass(context); }
+    else { task_finish_taa_history(context); }
     task_draw_imgui(context);
     context.main_task_list.task_list.submit({});
     context.main_task_list.task_list.present({});
@@ -338,9 +641,92 @@ void Renderer::create_main_task()
 void Renderer::resize()
 {
     context.swapchain.resize();
-    create_resolution_dependent_resources();
+    recreate_render_targets(true);
+}
 
-    context.conditionals.clear_accumulation = true;
+void Renderer::set_render_scale(f32 render_scale)
+{
+    render_scale = glm::clamp(render_scale, 0.5f, 1.0f);
+    if(render_scale == context.render_scale) { return; }
+
+    // the upsampling variant of the resolve only exists below native resolution
+    bool upsample_changed = (render_scale < 1.0f) != (context.render_scale < 1.0f);
+    context.render_scale = render_scale;
+    recreate_render_targets(false);
+    if(upsample_changed) { create_taa_pipelines(); }
+}
+
+auto Renderer::get_render_scale() const -> f32
+{
+    return context.render_scale;
+}
+
+void Renderer::set_dynamic_resolution(bool enabled, f32 budget_ms)
+{
+    dynamic_resolution.enabled = enabled;
+    dynamic_resolution.budget_ms = budget_ms;
+    dynamic_resolution.frames_under_budget = 0;
+}
+
+void Renderer::update_dynamic_resolution(f64 gpu_frame_time)
+{
+    auto & controller = dynamic_resolution;
+    controller.frames_since_change++;
+    if(!controller.enabled || controller.frames_since_change < DYNAMIC_RESOLUTION_SETTLE_FRAMES) { return; }
+
+    // the frame cost is dominated by the pixel count which goes with the square of the scale
+    f64 target_ms = controller.budget_ms * DYNAMIC_RESOLUTION_HEADROOM;
+    f32 ideal_scale = context.render_scale * static_cast<f32>(glm::sqrt(target_ms / glm::max(gpu_frame_time, 0.01)));
+    f32 new_scale = context.render_scale;
+    if(gpu_frame_time > controller.budget_ms)
+    {
+        // over budget - drop straight to the ideal scale
+        new_scale = glm::floor(ideal_scale / DYNAMIC_RESOLUTION_STEP) * DYNAMIC_RESOLUTION_STEP;
+        controller.frames_under_budget = 0;
+    }
+    else if(ideal_scale >= context.render_scale + DYNAMIC_RESOLUTION_STEP)
+    {
+        // under the headroom target - only go up one step after it held for a while
+        if(++controller.frames_under_budget >= DYNAMIC_RESOLUTION_UPSCALE_FRAMES)
+        {
+            new_scale = context.render_scale + DYNAMIC_RESOLUTION_STEP;
+            controller.frames_under_budget = 0;
+        }
+    }
+    else
+    {
+        controller.frames_under_budget = 0;
+    }
+
+    new_scale = glm::clamp(new_scale, 0.5f, 1.0f);
+    if(glm::abs(new_scale - context.render_scale) < DYNAMIC_RESOLUTION_STEP * 0.5f) { return; }
+    set_render_scale(new_scale);
+    controller.frames_since_change = 0;
+}
+
+void Renderer::recreate_render_targets(bool output_resolution)
+{
+    daxa::ImageId prev_velocity_image = context.main_task_list.prev_velocity_image;
+    daxa::ImageId accumulation_image = context.main_task_list.accumulation_image;
+    create_resolution_dependent_resources(output_resolution);
+
+    // the accumulated history and the velocity it was reprojected with are resampled into the new images
+    // instead of starting the accumulation over, velocities are in uv units and stay valid at any size
+    // every frame ends with both of them in READ_ONLY_OPTIMAL, as the next one expects them
+    if(output_resolution)
+    {
+        resample_history(context, {
+            {.src = accumulation_image, .dst = context.main_task_list.accumulation_image, .src_layout = daxa::ImageLayout::READ_ONLY_OPTIMAL},
+            {.src = prev_velocity_image, .dst = context.main_task_list.prev_velocity_image, .src_layout = daxa::ImageLayout::READ_ONLY_OPTIMAL},
+        });
+        context.device.destroy_image(accumulation_image);
+    } else {
+        resample_history(context, {
+            {.src = prev_velocity_image, .dst = context.main_task_list.prev_velocity_image, .src_layout = daxa::ImageLayout::READ_ONLY_OPTIMAL},
+        });
+    }
+    context.device.destroy_image(prev_velocity_image);
+    context.conditionals.hiz_valid = false;
 
     context.main_task_list.task_list.add_runtime_image(
         context.main_task_list.images.t_velocity_image,
@@ -350,17 +736,32 @@ void Renderer::resize()
         context.main_task_list.images.t_prev_velocity_image,
         context.main_task_list.prev_velocity_image);
 
-    context.main_task_list.task_list.add_runtime_image(
-        context.main_task_list.images.t_offscreen_image,
-        context.main_task_list.offscreen_image);
+    if(output_resolution)
+    {
+        context.main_task_list.task_list.add_runtime_buffer(
+            context.main_task_list.buffers.t_taa_tiles,
+            context.buffers.taa_tiles);
 
-    context.main_task_list.task_list.add_runtime_image(
-            context.main_task_list.images.t_accumulation_image,
-            context.main_task_list.accumulation_image);
+        context.main_task_list.task_list.add_runtime_buffer(
+            context.main_task_list.buffers.t_taa_tile_states,
+            context.buffers.taa_tile_states);
+
+        context.main_task_list.task_list.add_runtime_image(
+            context.main_task_list.images.t_offscreen_image,
+            context.main_task_list.offscreen_image);
+
+        context.main_task_list.task_list.add_runtime_image(
+                context.main_task_list.images.t_accumulation_image,
+                context.main_task_list.accumulation_image);
+
+        context.main_task_list.task_list.add_runtime_image(
+            context.main_task_list.images.t_taa_reference_image,
+            context.taa_reference_image);
+    }
 
     context.main_task_list.task_list.add_runtime_image(
-        context.main_task_list.images.t_offscreen_copy_image,
-        context.offscreen_copy_image);
+        context.main_task_list.images.t_scene_color_image,
+        context.scene_color_image);
 
     context.main_task_list.task_list.add_runtime_image(
         context.main_task_list.images.t_depth_image,
@@ -410,6 +811,8 @@ void Renderer::swap_offscreen_images()
 
 void Renderer::draw(Camera & camera)
 {
+    if(pending_scene != nullptr && !context.upload_ring.has_deferred_uploads()) { swap_pending_scene(); }
+
     auto extent = context.swapchain.get_surface_extent();
     auto m_proj_view = camera.get_view_projection_matrix({
         .near_plane = 0.1f,
@@ -419,9 +822,23 @@ void Renderer::draw(Camera & camera)
 
     auto m_prev_proj_view = context.buffers.transforms_buffer.cpu_buffer.m_proj_view;
     auto m_inv_proj_view = glm::inverse(m_proj_view);
-    auto m_jitter = camera.get_camera_jitter_matrix({extent.x, extent.y});
+    // the sequence gets longer with the upsampling ratio so that every output pixel still receives enough distinct samples
+    auto jitter_phase_count = static_cast<u32>(glm::ceil(32.0f / (context.render_scale * context.render_scale)));
+    // identity without jitter so that TAA can always undo the offset the depth was rasterized with
+    auto m_jitter = context.conditionals.jitter_camera ?
+        camera.get_camera_jitter_matrix({context.render_extent.x, context.render_extent.y}, jitter_phase_count) :
+        f32mat4x4(1.0f);
+
+    auto & transforms = context.buffers.transforms_buffer.cpu_buffer;
+    // the instance transforms stay valid as long as both view projections are unchanged,
+    // the jitter is applied in the vertex shader and does not invalidate them
+    if(memcmp(&transforms.m_proj_view, &m_proj_view, sizeof(daxa::f32mat4x4)) != 0 ||
+       memcmp(&transforms.m_prev_proj_view, &m_prev_proj_view, sizeof(daxa::f32mat4x4)) != 0)
+    {
+        context.conditionals.update_instance_transforms = true;
+    }
 
-    context.buffers.transforms_buffer.cpu_buffer = {
+    transforms = {
         .m_prev_proj_view = m_prev_proj_view,
         .m_inv_proj_view = *reinterpret_cast<daxa::f32mat4x4 *>(&m_inv_proj_view),
         .m_proj_view = *reinterpret_cast<daxa::f32mat4x4 *>(&m_proj_view),
@@ -430,6 +847,35 @@ void Renderer::draw(Camera & camera)
 
     context.conditionals.fill_transforms = true;
 
+    CullSceneInfo cull_info = {
+        .m_proj_view = m_proj_view,
+        .camera_position = camera.get_camera_position(),
+        .lod_error_scale = static_cast<f32>(context.render_extent.y) / (2.0f * glm::tan(camera.fov * 0.5f))
+    };
+    if(context.conditionals.gpu_culling)
+    {
+        context.culling_params = {
+            .camera_position = cull_info.camera_position,
+            .lod_error_scale = cull_info.lod_error_scale,
+            .lod_error_threshold = cull_info.lod_error_threshold,
+        };
+    } else if(context.conditionals.static_batching) {
+        drawn_triangles = context.render_info.full_detail_triangles;
+        full_detail_triangles = context.render_info.full_detail_triangles;
+        visible_instances = context.render_info.instances.size();
+        culled_instances = 0;
+        occluded_instances = 0;
+        draw_calls = context.render_info.instances.empty() ? 0 : 1;
+    } else {
+        auto cull_stats = cull_scene(context, cull_info);
+        drawn_triangles = cull_stats.drawn_triangles;
+        full_detail_triangles = cull_stats.full_detail_triangles;
+        visible_instances = cull_stats.visible_instances;
+        culled_instances = cull_stats.culled_instances;
+        occluded_instances = 0;
+        draw_calls = cull_stats.draw_calls;
+    }
+
     context.main_task_list.task_list.remove_runtime_image(
         context.main_task_list.images.t_swapchain_image,
         context.swapchain_image);
@@ -445,45 +891,187 @@ void Renderer::draw(Camera & camera)
         DEBUG_OUT("[Renderer::draw()] Got empty image from swapchain");
         return;
     }
+    // acquire waited for the frame which used the oldest ring segment so it can be written again
+    context.upload_ring.begin_frame();
+    if(context.conditionals.gpu_culling)
+    {
+        // the slot of this segment was last written by a frame which has finished, the counts lag a few frames behind
+        const auto & gpu_count = context.device.get_host_address_as<SceneDrawCount>(context.buffers.draw_count_readback)[context.upload_ring.segment_index];
+        u64 gpu_visible = gpu_count.early_draw_count + gpu_count.late_draw_count;
+        drawn_triangles = gpu_count.triangle_count;
+        full_detail_triangles = context.render_info.full_detail_triangles;
+        visible_instances = gpu_visible;
+        culled_instances = context.render_info.instances.size() - glm::min(gpu_visible, static_cast<u64>(context.render_info.instances.size()));
+        occluded_instances = gpu_count.occluded_count - glm::min(gpu_count.late_draw_count, gpu_count.occluded_count);
+        draw_calls = gpu_visible;
+    }
+    if(context.conditionals.count_overdraw)
+    {
+        const auto & fragment_count = context.device.get_host_address_as<SceneFragmentCount>(context.buffers.fragment_count_readback)[context.upload_ring.segment_index];
+        overdraw = static_cast<f32>(fragment_count.fragment_count) / static_cast<f32>(context.render_extent.x * context.render_extent.y);
+    }
+    if(context.conditionals.compare_taa_precision)
+    {
+        // the slot of this segment is written again by the frame recorded below
+        auto & precision_diff = context.device.get_host_address_as<TAAPrecisionDiff>(context.buffers.taa_precision_diff_readback)[context.upload_ring.segment_index];
+        f32 max_difference;
+        std::memcpy(&max_difference, &precision_diff.max_difference, sizeof(f32));
+        taa_precision_max_difference = max_difference;
+        taa_precision_differing_pixels = precision_diff.differing_pixels;
+        precision_diff = {};
+    }
     context.main_task_list.task_list.execute();
+    // the pyramid built at the end of this frame serves the early culling pass of the next one
+    context.conditionals.hiz_valid = context.conditionals.gpu_culling && context.conditionals.occlusion_culling;
 
     swap_offscreen_images();
 
-    auto result = context.pipeline_manager.reload_all();
-    if(result.is_ok()) {
-        if (result.value() == true)
-        {
-            DEBUG_OUT("[Renderer::draw()] Shaders recompiled successfully");
-        }
-    } else {
-        DEBUG_OUT(result.to_string());
-    }
+    context.pipeline_cache.reload_changed();
 
     auto query_results = context.timestamps.get_query_results(0, 4);
+    // the timestamps count in device specific ticks
+    f64 timestamp_period_ns = static_cast<f64>(context.device.properties().limits.timestamp_period);
     if ((query_results[1] != 0u) && (query_results[3] != 0u))
     {
-        draw_time = static_cast<f64>(query_results[2] - query_results[0]) / 1000.0;
+        draw_time = static_cast<f64>(query_results[2] - query_results[0]) * timestamp_period_ns / 1000.0;
     }
     if ((query_results[5] != 0u) && (query_results[7] != 0u))
     {
-        taa_time = static_cast<f64>(query_results[6] - query_results[4]) / 1000.0;
+        taa_time = static_cast<f64>(query_results[6] - query_results[4]) * timestamp_period_ns / 1000.0;
+        if(frames_since_footprint_change > MAX_FRAMES_IN_FLIGHT)
+        {
+            auto & footprint_time = taa_footprint_time[static_cast<usize>(get_taa_footprint())];
+            footprint_time = footprint_time == 0.0 ? taa_time : glm::mix(footprint_time, taa_time, 0.05);
+        }
+        frames_since_footprint_change++;
     }
+    // from the start of the scene to the end of the resolve, in milliseconds
+    if ((query_results[1] != 0u) && (query_results[7] != 0u))
+    {
+        update_dynamic_resolution(static_cast<f64>(query_results[6] - query_results[0]) * timestamp_period_ns / 1000000.0);
+    }
+}
+
+void Renderer::set_taa_tile_size(u32 tile_size)
+{
+    context.conditionals.taa_tile_size = tile_size;
+}
+
+void Renderer::set_taa_tile_classification(bool enabled)
+{
+    context.conditionals.taa_tile_classification = enabled;
+    // the states stop being updated while the classification is off
+    context.conditionals.reset_taa_tiles = true;
+}
+
+void Renderer::set_taa_fp16(bool enabled)
+{
+    context.conditionals.taa_fp16 = enabled && context.taa_fp16_supported;
+    create_taa_pipelines();
+}
+
+auto Renderer::is_taa_fp16_supported() const -> bool
+{
+    return context.taa_fp16_supported;
+}
+
+void Renderer::set_taa_precision_comparison(bool enabled)
+{
+    context.conditionals.compare_taa_precision = enabled;
+    taa_precision_max_difference = 0.0f;
+    taa_precision_differing_pixels = 0;
+    // the classification pauses while comparing
+    context.conditionals.reset_taa_tiles = true;
+    // the reference image is only allocated at full size while comparing
+    recreate_render_targets(true);
+}
+
+auto Renderer::get_taa_footprint() const -> TAAFootprint
+{
+    if(context.conditionals.taa_footprint_plus) { return TAAFootprint::PLUS; }
+    if(context.conditionals.taa_footprint_separable) { return TAAFootprint::SEPARABLE; }
+    return TAAFootprint::SQUARE;
+}
+
+void Renderer::create_taa_pipelines()
+{
+    // variants compiled before are reused as they are, a variant failing to compile keeps the previous pipeline
+    // and leaves nullptr at startup, which the TAA tasks check for
+    auto replace = [&](std::shared_ptr<daxa::ComputePipeline> & pipeline, TAAKernel kernel)
+    {
+        auto variant = context.pipeline_cache.get_compute_pipeline(get_taa_pass_pipeline(context, kernel));
+        if(variant != nullptr) { pipeline = variant; }
+    };
+    replace(context.pipelines.p_taa_pass, TAAKernel::FULL);
+    replace(context.pipelines.p_taa_reference, TAAKernel::FP32_REFERENCE);
+    replace(context.pipelines.p_taa_classify, TAAKernel::CLASSIFY);
+    replace(context.pipelines.p_taa_tiles[TAA_TILE_CLASS_STATIC], TAAKernel::STATIC_TILES);
+    replace(context.pipelines.p_taa_tiles[TAA_TILE_CLASS_MOVING], TAAKernel::MOVING_TILES);
+    replace(context.pipelines.p_taa_tiles[TAA_TILE_CLASS_DISOCCLUDED], TAAKernel::DISOCCLUDED_TILES);
 }
 
 void Renderer::reload_taa_pipeline()
 {
-    context.pipeline_manager.remove_compute_pipeline(context.pipelines.p_taa_pass);
     context.conditionals.clear_accumulation = true;
-    context.pipelines.p_taa_pass = context.pipeline_manager.add_compute_pipeline(get_taa_pass_pipeline(context)).value();
+    // the tile size may have changed with it
+    context.conditionals.reset_taa_tiles = true;
+    create_taa_pipelines();
+}
+
+void Renderer::set_meshlet_cone_culling(bool enabled)
+{
+    context.conditionals.meshlet_cone_culling = enabled;
+}
+
+void Renderer::set_gpu_culling(bool enabled)
+{
+    context.conditionals.gpu_culling = enabled;
+    // the CPU path rewrites the visible instances every frame on its own
+    context.render_info.visible_draws.clear();
+}
+
+void Renderer::set_occlusion_culling(bool enabled)
+{
+    context.conditionals.occlusion_culling = enabled;
+    context.conditionals.hiz_valid = false;
+}
+
+void Renderer::set_depth_prepass(bool enabled)
+{
+    context.conditionals.depth_prepass = enabled;
+}
+
+void Renderer::set_lod_selection(bool enabled)
+{
+    context.conditionals.lod_selection = enabled;
+}
+
+void Renderer::set_depth_sort(bool enabled)
+{
+    context.conditionals.depth_sort = enabled;
+}
+
+void Renderer::set_static_batching(bool enabled)
+{
+    context.conditionals.static_batching = enabled;
+    context.render_info.visible_draws.clear();
 }
 
 void Renderer::change_shader_define(Define define, bool new_value)
 {
-    if(define == Define::JITTER)
+    if(define == Define::JITTER || define == Define::COUNT_OVERDRAW || define == Define::DEPTH_VELOCITY)
     {
-        context.pipeline_manager.remove_raster_pipeline(context.pipelines.p_draw_scene);
-        context.conditionals.jitter_camera = new_value;
-        context.pipelines.p_draw_scene = context.pipeline_manager.add_raster_pipeline(get_draw_scene_pipeline(context)).value();
+        if(define == Define::JITTER) { context.conditionals.jitter_camera = new_value; }
+        else if(define == Define::COUNT_OVERDRAW) { context.conditionals.count_overdraw = new_value; }
+        else
+        {
+            context.conditionals.depth_velocity = new_value;
+            // the velocity images shrink to placeholders or grow back to the render extent
+            recreate_render_targets(false);
+        }
+        context.pipelines.p_draw_scene = context.pipeline_cache.get_raster_pipeline(get_draw_scene_pipeline(context));
+        context.pipelines.p_draw_scene_depth = context.pipeline_cache.get_raster_pipeline(get_draw_scene_pipeline(context, ScenePipeline::DEPTH_ONLY));
+        context.pipelines.p_shade_scene = context.pipeline_cache.get_raster_pipeline(get_draw_scene_pipeline(context, ScenePipeline::SHADE));
         return;
     }
 
@@ -494,101 +1082,467 @@ void Renderer::change_shader_define(Define define, bool new_value)
         case Define::NEAREST_DEPTH : { context.conditionals.nearest_depth = new_value; break; }
         case Define::REJECT_VELOCITY: { context.conditionals.velocity_rejection = new_value; break; }
         case Define::REPROJECT_VELOCITY: { context.conditionals.velocity_reproject = new_value; break; }
+        case Define::TAA_FOOTPRINT_PLUS:
+        {
+            context.conditionals.taa_footprint_plus = new_value;
+            if(new_value) { context.conditionals.taa_footprint_separable = false; }
+            frames_since_footprint_change = 0;
+            break;
+        }
+        case Define::TAA_FOOTPRINT_SEPARABLE:
+        {
+            context.conditionals.taa_footprint_separable = new_value;
+            if(new_value) { context.conditionals.taa_footprint_plus = false; }
+            frames_since_footprint_change = 0;
+            break;
+        }
+        default: { break; }
     }
 }
 
-void Renderer::reload_scene_data(const Scene & scene)
+#if defined(COMPACT_VERTICES)
+// Quantizes positions to 16 bits relative to the mesh AABB and octahedral encodes normals into 2x16 bits.
+// Returns the transform mapping the quantized positions back into mesh space.
+static auto encode_compact_vertices(std::span<const Vertex> vertices, SceneGeometryVertices * out) -> f32mat4x4
 {
-    auto destroy_buffer_if_valid = [&]<typename T>(
-        RendererContext::Buffers::SharedBuffer<T> & buffer,
-        const daxa::TaskBufferId task_buffer) -> void
+    if(vertices.empty()) { return f32mat4x4(1.0f); }
+
+    f32vec3 aabb_min = vertices[0].position;
+    f32vec3 aabb_max = vertices[0].position;
+    for(const auto & vertex : vertices)
+    {
+        aabb_min = glm::min(aabb_min, vertex.position);
+        aabb_max = glm::max(aabb_max, vertex.position);
+    }
+    const f32 MAX_QUANTIZED = 65535.0f;
+    f32vec3 step = glm::max(aabb_max - aabb_min, f32vec3(EPSILON)) / MAX_QUANTIZED;
+
+    auto encode_snorm16 = [](f32 value) -> u32
+    {
+        return static_cast<u32>(static_cast<u16>(static_cast<i16>(glm::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f))));
+    };
+
+    for(usize vertex = 0; vertex < vertices.size(); vertex++)
     {
-        if(context.device.is_id_valid(buffer.gpu_buffer))
+        f32vec3 quantized = glm::round((vertices[vertex].position - aabb_min) / step);
+        u32vec3 position = u32vec3(glm::clamp(quantized, f32vec3(0.0f), f32vec3(MAX_QUANTIZED)));
+
+        // project onto the octahedron and fold the lower hemisphere over the diagonals
+        f32vec3 normal = vertices[vertex].normal;
+        normal /= glm::max(glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z), EPSILON);
+        f32vec2 octahedral = f32vec2(normal.x, normal.y);
+        if(normal.z < 0.0f)
         {
-            context.main_task_list.task_list.remove_runtime_buffer(task_buffer, buffer.gpu_buffer);
-            context.device.destroy_buffer(buffer.gpu_buffer);
-            buffer.cpu_buffer.clear();
+            octahedral = f32vec2(
+                (1.0f - glm::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - glm::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
         }
-    };
 
-    destroy_buffer_if_valid(context.buffers.scene_vertices, context.main_task_list.buffers.t_scene_vertices);
-    destroy_buffer_if_valid(context.buffers.scene_indices, context.main_task_list.buffers.t_scene_indices);
-    destroy_buffer_if_valid(context.buffers.scene_lights, context.main_task_list.buffers.t_scene_lights);
+        out[vertex] = SceneGeometryVertices{
+            .position_xy = position.x | (position.y << 16u),
+            .position_z = position.z,
+            .normal = encode_snorm16(octahedral.x) | (encode_snorm16(octahedral.y) << 16u),
+        };
+    }
 
-    context.render_info.objects.clear();
-    size_t scene_vertex_cnt = 0;
-    size_t scene_index_cnt = 0;
+    f32mat4x4 decode = glm::translate(f32mat4x4(1.0f), aabb_min);
+    return glm::scale(decode, step);
+}
+#endif
 
+static void destroy_scene_buffers(daxa::Device & device, RendererContext::SceneBuffers & buffers)
+{
+    for(auto * buffer : {&buffers.vertices, &buffers.indices, &buffers.lights, &buffers.instances, &buffers.instance_transforms, &buffers.visible_instances,
+                         &buffers.meshes, &buffers.draws, &buffers.draw_commands, &buffers.draw_count, &buffers.occluded_instances,
+                         &buffers.static_draw_commands, &buffers.static_visible_instances})
+    {
+        if(device.is_id_valid(*buffer)) { device.destroy_buffer(*buffer); }
+        *buffer = {};
+    }
+}
+
+PreparedScene::PreparedScene(daxa::Device device) : device{std::move(device)}
+{
+}
+
+PreparedScene::~PreparedScene()
+{
+    destroy_scene_buffers(device, buffers);
+}
+
+auto Renderer::prepare_scene_data(const Scene & scene, SceneLoadProgress * progress) -> std::unique_ptr<PreparedScene>
+{
+    auto prepared_scene = std::make_unique<PreparedScene>(context.device);
+    auto & render_info = prepared_scene->render_info;
+    auto & buffers = prepared_scene->buffers;
+
+    std::vector<SceneLights> lights;
     for(const auto & scene_light : scene.scene_lights)
     {
         f32vec4 light_position = scene_light.transform * scene_light.position;
-        context.buffers.scene_lights.cpu_buffer.push_back(SceneLights{
+        lights.push_back(SceneLights{
             .position = daxa_vec4_from_glm(light_position)
         });
     }
+    render_info.light_count = static_cast<u32>(lights.size());
+
+    // gather the source geometry of every mesh, cached scenes point directly into the mapped cache file
+    struct PackMesh
+    {
+        std::span<const Vertex> vertices;
+        // every level indexes into the same vertices, lod_indices[0] is the full detail mesh
+        std::array<std::span<const u32>, MAX_MESH_LODS> lod_indices;
+        std::array<f32, MAX_MESH_LODS> lod_errors;
+        u32 lod_count;
+    };
+    std::vector<PackMesh> pack_meshes;
+    if(scene.cache != nullptr)
+    {
+        const auto & cache = *scene.cache;
+        for(const auto & cached_object : cache.objects)
+        {
+            for(u32 mesh_index : cache.object_meshes.subspan(cached_object.first_mesh, cached_object.mesh_count))
+            {
+                render_info.instances.push_back({
+                    .model_transform = cached_object.transform,
+                    .mesh_index = mesh_index,
+                });
+            }
+        }
+        for(const auto & cached_mesh : cache.meshes)
+        {
+            PackMesh pack_mesh = {
+                .vertices = cache.vertices.subspan(cached_mesh.first_vertex, cached_mesh.vertex_count),
+                .lod_count = cached_mesh.lod_count,
+            };
+            // levels are stored back to back after the first index of the mesh
+            u32 lod_first_index = cached_mesh.first_index;
+            for(u32 lod = 0; lod < cached_mesh.lod_count; lod++)
+            {
+                pack_mesh.lod_indices[lod] = cache.indices.subspan(lod_first_index, cached_mesh.lod_index_counts[lod]);
+                pack_mesh.lod_errors[lod] = cached_mesh.lod_errors[lod];
+                lod_first_index += cached_mesh.lod_index_counts[lod];
+            }
+            pack_meshes.push_back(pack_mesh);
+        }
+    }
+    else
+    {
+        for(const auto & scene_object : scene.scene_objects)
+        {
+            for(u32 mesh_index : scene_object.mesh_indices)
+            {
+                render_info.instances.push_back({
+                    .model_transform = scene_object.transform,
+                    .mesh_index = mesh_index,
+                });
+            }
+        }
+        for(const auto & scene_runtime_mesh : scene.meshes)
+        {
+            PackMesh pack_mesh = {
+                .vertices = scene_runtime_mesh.vertices,
+                .lod_count = static_cast<u32>(glm::min(scene_runtime_mesh.lods.size() + 1, static_cast<usize>(MAX_MESH_LODS))),
+            };
+            pack_mesh.lod_indices[0] = scene_runtime_mesh.indices;
+            pack_mesh.lod_errors[0] = 0.0f;
+            for(u32 lod = 1; lod < pack_mesh.lod_count; lod++)
+            {
+                pack_mesh.lod_indices[lod] = scene_runtime_mesh.lods[lod - 1].indices;
+                pack_mesh.lod_errors[lod] = scene_runtime_mesh.lods[lod - 1].error;
+            }
+            pack_meshes.push_back(pack_mesh);
+        }
+    }
 
-    // pack scene vertices and scene indices into their separate GPU buffers
-    for(const auto & scene_object : scene.scene_objects)
+    // prefix sum over the mesh sizes gives every mesh its slice of the destination buffers so the copies can run in parallel
+    std::vector<usize> vertex_offsets(pack_meshes.size());
+    std::vector<usize> index_offsets(pack_meshes.size());
+    for(usize mesh_idx = 0; mesh_idx < pack_meshes.size(); mesh_idx++)
     {
-        context.render_info.objects.push_back({
-            .model_transform = scene_object.transform,
+        vertex_offsets[mesh_idx] = pack_meshes[mesh_idx].vertices.size();
+        index_offsets[mesh_idx] = 0;
+        for(u32 lod = 0; lod < pack_meshes[mesh_idx].lod_count; lod++)
+        {
+            index_offsets[mesh_idx] += pack_meshes[mesh_idx].lod_indices[lod].size();
+        }
+    }
+    usize scene_vertex_cnt = exclusive_prefix_sum(vertex_offsets);
+    usize scene_index_cnt = exclusive_prefix_sum(index_offsets);
+    // at least one element so that the buffers stay valid for empty scenes
+    usize instance_cnt = glm::max(render_info.instances.size(), usize(1));
+
+    // every buffer gets a 16 byte aligned region of one CPU side upload blob, the geometry is packed
+    // straight into it and streamed to the GPU through the upload ring once the scene is swapped in
+    auto create_scene_buffer = [&](daxa::BufferId & buffer, usize size, const char * debug_name) -> u32
+    {
+        size = glm::max(size, usize(16));
+        buffer = context.device.create_buffer({
+            .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+            .size = static_cast<u32>(size),
+            .debug_name = debug_name
         });
-        auto & object = context.render_info.objects.back();
+        u32 src_offset = prepared_scene->uploads.empty() ? 0u :
+            (prepared_scene->uploads.back().src_offset + prepared_scene->uploads.back().size + 15u) & ~15u;
+        prepared_scene->uploads.push_back({.dst_buffer = buffer, .src_offset = src_offset, .size = static_cast<u32>(size)});
+        return src_offset;
+    };
+    u32 vertices_offset = create_scene_buffer(buffers.vertices, scene_vertex_cnt * sizeof(SceneGeometryVertices), "scene_geometry_vertices");
+    u32 indices_offset = create_scene_buffer(buffers.indices, scene_index_cnt * sizeof(SceneGeometryIndices), "scene_geometry_indices");
+    u32 lights_offset = create_scene_buffer(buffers.lights, lights.size() * sizeof(SceneLights), "scene_lights");
+    u32 instances_offset = create_scene_buffer(buffers.instances, instance_cnt * sizeof(SceneInstances), "scene_instances");
+    u32 meshes_offset = create_scene_buffer(buffers.meshes, pack_meshes.size() * sizeof(SceneMeshes), "scene_meshes");
+    u32 draws_offset = create_scene_buffer(buffers.draws, instance_cnt * sizeof(SceneDraws), "scene_draws");
+    u32 static_draw_commands_offset = create_scene_buffer(buffers.static_draw_commands, glm::max(pack_meshes.size(), usize(1)) * sizeof(SceneDrawCommands), "static_draw_commands");
+    u32 static_visible_instances_offset = create_scene_buffer(buffers.static_visible_instances, instance_cnt * sizeof(SceneVisibleInstances), "static_visible_instances");
+    buffers.instance_transforms = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = static_cast<u32>(instance_cnt * sizeof(SceneInstanceTransforms)),
+        .debug_name = "instance_transforms"
+    });
+    // one slot per instance for each of the early and the late culling pass
+    buffers.visible_instances = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = static_cast<u32>(2 * instance_cnt * sizeof(SceneVisibleInstances)),
+        .debug_name = "visible_instances"
+    });
+    buffers.draw_commands = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = static_cast<u32>(2 * instance_cnt * sizeof(SceneDrawCommands)),
+        .debug_name = "draw_commands"
+    });
+    buffers.occluded_instances = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = static_cast<u32>(instance_cnt * sizeof(SceneOccludedInstances)),
+        .debug_name = "occluded_instances"
+    });
+    buffers.draw_count = context.device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .size = sizeof(SceneDrawCount),
+        .debug_name = "draw_count"
+    });
+    auto upload_data = std::make_shared<std::vector<u8>>(prepared_scene->uploads.back().src_offset + prepared_scene->uploads.back().size);
+    auto * staging_ptr = upload_data->data();
+    auto * vertices_staging = reinterpret_cast<SceneGeometryVertices *>(staging_ptr + vertices_offset);
+    auto * indices_staging = reinterpret_cast<u32 *>(staging_ptr + indices_offset);
+
+    std::vector<f32mat4x4> position_decode(pack_meshes.size(), f32mat4x4(1.0f));
+    std::vector<std::array<std::vector<Meshlet>, MAX_MESH_LODS>> mesh_meshlets(pack_meshes.size());
+    context.job_system->parallel_for(pack_meshes.size(), 16, [&](usize begin, usize end)
+    {
+        for(usize mesh_idx = begin; mesh_idx < end; mesh_idx++)
+        {
+            if(progress != nullptr && progress->cancelled) { return; }
+            const auto & pack_mesh = pack_meshes[mesh_idx];
+            auto * vertices_dst = vertices_staging + vertex_offsets[mesh_idx];
+#if defined(COMPACT_VERTICES)
+            position_decode[mesh_idx] = encode_compact_vertices(pack_mesh.vertices, vertices_dst);
+#else
+            memcpy(vertices_dst, pack_mesh.vertices.data(), sizeof(SceneGeometryVertices) * pack_mesh.vertices.size());
+#endif
+            auto * indices_dst = indices_staging + index_offsets[mesh_idx];
+            for(u32 lod = 0; lod < pack_mesh.lod_count; lod++)
+            {
+                memcpy(indices_dst, pack_mesh.lod_indices[lod].data(), sizeof(u32) * pack_mesh.lod_indices[lod].size());
+                indices_dst += pack_mesh.lod_indices[lod].size();
+                mesh_meshlets[mesh_idx][lod] = build_meshlets(pack_mesh.vertices, pack_mesh.lod_indices[lod]);
+            }
+        }
+    });
+    // the buffers created so far are released together with the prepared scene
+    if(progress != nullptr && progress->cancelled) { return nullptr; }
+    if(progress != nullptr) { progress->fraction = 0.95f; }
 
-        for(auto scene_runtime_mesh : scene_object.meshes)
+    render_info.meshes.resize(pack_meshes.size());
+    for(usize mesh_idx = 0; mesh_idx < pack_meshes.size(); mesh_idx++)
+    {
+        const auto & pack_mesh = pack_meshes[mesh_idx];
+        auto & mesh = render_info.meshes[mesh_idx];
+        mesh = {
+            .index_offset = static_cast<u32>(vertex_offsets[mesh_idx]),
+            .position_decode = position_decode[mesh_idx],
+            .lod_count = pack_mesh.lod_count,
+        };
+        u32 lod_index_buffer_offset = static_cast<u32>(index_offsets[mesh_idx]);
+        for(u32 lod = 0; lod < pack_mesh.lod_count; lod++)
         {
-            object.meshes.push_back({
-                .index_buffer_offset = static_cast<u32>(scene_index_cnt),
-                .index_offset = static_cast<u32>(scene_vertex_cnt),
-                .index_count = static_cast<u32>(scene_runtime_mesh.indices.size()),
-            });
-            auto & mesh = object.meshes.back();
+            const auto & lod_meshlets = mesh_meshlets[mesh_idx][lod];
+            mesh.lods[lod] = {
+                .index_buffer_offset = lod_index_buffer_offset,
+                .index_count = static_cast<u32>(pack_mesh.lod_indices[lod].size()),
+                .first_meshlet = static_cast<u32>(render_info.meshlets.size()),
+                .meshlet_count = static_cast<u32>(lod_meshlets.size()),
+                .error = pack_mesh.lod_errors[lod],
+            };
+            lod_index_buffer_offset += mesh.lods[lod].index_count;
+            render_info.meshlets.insert(render_info.meshlets.end(), lod_meshlets.begin(), lod_meshlets.end());
+        }
 
-            context.buffers.scene_vertices.cpu_buffer.resize(scene_vertex_cnt + scene_runtime_mesh.vertices.size());
-            memcpy(context.buffers.scene_vertices.cpu_buffer.data() + scene_vertex_cnt,
-                   scene_runtime_mesh.vertices.data(),
-                   sizeof(SceneGeometryVertices) * scene_runtime_mesh.vertices.size());
-            scene_vertex_cnt += scene_runtime_mesh.vertices.size();
+        f32vec3 bounds_min = f32vec3(std::numeric_limits<f32>::max());
+        f32vec3 bounds_max = f32vec3(std::numeric_limits<f32>::lowest());
+        for(const auto & meshlet : mesh_meshlets[mesh_idx][0])
+        {
+            bounds_min = glm::min(bounds_min, meshlet.center - meshlet.radius);
+            bounds_max = glm::max(bounds_max, meshlet.center + meshlet.radius);
+        }
+        mesh.bounds = {.min = bounds_min, .max = bounds_max};
+        if(!mesh.bounds.is_empty())
+        {
+            mesh.bounds_center = (bounds_min + bounds_max) * 0.5f;
+            mesh.bounds_radius = glm::length(bounds_max - mesh.bounds_center);
+        } else {
+            mesh.bounds_center = f32vec3(0.0f);
+            mesh.bounds_radius = 0.0f;
+        }
+    }
 
-            context.buffers.scene_indices.cpu_buffer.resize(scene_index_cnt + scene_runtime_mesh.indices.size());
-            memcpy(context.buffers.scene_indices.cpu_buffer.data() + scene_index_cnt,
-                   scene_runtime_mesh.indices.data(),
-                   sizeof(u32) * scene_runtime_mesh.indices.size());
-            scene_index_cnt += scene_runtime_mesh.indices.size();
+    std::vector<Aabb> instance_bounds(render_info.instances.size());
+    for(usize instance_idx = 0; instance_idx < render_info.instances.size(); instance_idx++)
+    {
+        const auto & instance = render_info.instances[instance_idx];
+        const auto & mesh = render_info.meshes[instance.mesh_index];
+        // empty boxes stay empty and keep the instance out of the BVH
+        instance_bounds[instance_idx] = mesh.bounds.is_empty() ? mesh.bounds : transform_aabb(mesh.bounds, instance.model_transform);
+        if(mesh.lod_count > 0) { render_info.full_detail_triangles += mesh.lods[0].index_count / 3; }
+    }
+    render_info.bvh = build_scene_bvh(instance_bounds);
+
+    static_assert(SCENE_MAX_MESH_LODS == MAX_MESH_LODS);
+    auto * meshes_staging = reinterpret_cast<SceneMeshes *>(staging_ptr + meshes_offset);
+    for(usize mesh_idx = 0; mesh_idx < render_info.meshes.size(); mesh_idx++)
+    {
+        const auto & mesh = render_info.meshes[mesh_idx];
+        auto & gpu_mesh = meshes_staging[mesh_idx];
+        gpu_mesh = {.vertex_offset = mesh.index_offset, .lod_count = mesh.lod_count};
+        for(u32 lod = 0; lod < mesh.lod_count; lod++)
+        {
+            gpu_mesh.lod_first_index[lod] = mesh.lods[lod].index_buffer_offset;
+            gpu_mesh.lod_index_count[lod] = mesh.lods[lod].index_count;
+            gpu_mesh.lod_error[lod] = mesh.lods[lod].error;
         }
     }
+    auto * draws_staging = reinterpret_cast<SceneDraws *>(staging_ptr + draws_offset);
+    for(usize instance_idx = 0; instance_idx < render_info.instances.size(); instance_idx++)
+    {
+        const auto & instance = render_info.instances[instance_idx];
+        const auto & mesh = render_info.meshes[instance.mesh_index];
+        const auto & m_model = instance.model_transform;
+        f32 max_scale = glm::max(glm::length(f32vec3(m_model[0])), glm::max(glm::length(f32vec3(m_model[1])), glm::length(f32vec3(m_model[2]))));
+        draws_staging[instance_idx] = {
+            .center = daxa_vec3_from_glm(f32vec3(m_model * f32vec4(mesh.bounds_center, 1.0f))),
+            .radius = mesh.bounds_radius * max_scale,
+            .max_scale = max_scale,
+            .mesh_index = instance.mesh_index,
+        };
+    }
 
-    context.buffers.scene_vertices.gpu_buffer = context.device.create_buffer({
-        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .size = static_cast<u32>(scene_vertex_cnt * sizeof(SceneGeometryVertices)),
-        .debug_name = "scene_geometry_vertices"
-    });
+    auto * instances_staging = reinterpret_cast<SceneInstances *>(staging_ptr + instances_offset);
+    for(usize instance_idx = 0; instance_idx < render_info.instances.size(); instance_idx++)
+    {
+        const auto & instance = render_info.instances[instance_idx];
+        f32mat4x4 m_model = instance.model_transform * render_info.meshes[instance.mesh_index].position_decode;
+        instances_staging[instance_idx] = SceneInstances{
+            .m_model = *reinterpret_cast<daxa::f32mat4x4 *>(&m_model)
+        };
+    }
 
-    context.main_task_list.task_list.add_runtime_buffer(
-        context.main_task_list.buffers.t_scene_vertices,
-        context.buffers.scene_vertices.gpu_buffer);
+    // static batching - counting sort of the instances by mesh, every mesh then becomes a single instanced full detail command
+    std::vector<u32> mesh_instance_counts(render_info.meshes.size(), 0);
+    for(const auto & instance : render_info.instances) { mesh_instance_counts[instance.mesh_index]++; }
+    std::vector<u32> mesh_first_instance = mesh_instance_counts;
+    exclusive_prefix_sum(mesh_first_instance);
+    auto * static_draw_commands_staging = reinterpret_cast<SceneDrawCommands *>(staging_ptr + static_draw_commands_offset);
+    for(usize mesh_idx = 0; mesh_idx < render_info.meshes.size(); mesh_idx++)
+    {
+        const auto & mesh = render_info.meshes[mesh_idx];
+        if(mesh_instance_counts[mesh_idx] == 0 || mesh.lod_count == 0 || mesh.lods[0].index_count == 0) { continue; }
+        static_draw_commands_staging[render_info.static_draw_count++] = {
+            .index_count = mesh.lods[0].index_count,
+            .instance_count = mesh_instance_counts[mesh_idx],
+            .first_index = mesh.lods[0].index_buffer_offset,
+            .vertex_offset = static_cast<i32>(mesh.index_offset),
+            .first_instance = mesh_first_instance[mesh_idx],
+        };
+    }
+    auto * static_visible_instances_staging = reinterpret_cast<SceneVisibleInstances *>(staging_ptr + static_visible_instances_offset);
+    for(u32 instance_idx = 0; instance_idx < render_info.instances.size(); instance_idx++)
+    {
+        static_visible_instances_staging[mesh_first_instance[render_info.instances[instance_idx].mesh_index]++] = {.instance_index = instance_idx};
+    }
 
-    context.buffers.scene_indices.gpu_buffer = context.device.create_buffer({
-        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .size = static_cast<u32>(scene_index_cnt * sizeof(SceneGeometryIndices)),
-        .debug_name = "scene_geometry_indices"
-    });
+    memcpy(staging_ptr + lights_offset, lights.data(), lights.size() * sizeof(SceneLights));
+    prepared_scene->upload_data = std::move(upload_data);
 
-    context.main_task_list.task_list.add_runtime_buffer(
-        context.main_task_list.buffers.t_scene_indices,
-        context.buffers.scene_indices.gpu_buffer);
+    if(progress != nullptr) { progress->fraction = 1.0f; }
+    DEBUG_OUT("[Renderer::prepare_scene_data()] " << render_info.instances.size() << " instances of "
+              << render_info.meshes.size() << " unique meshes prepared, BVH with " << render_info.bvh.nodes.size() << " nodes");
+    return prepared_scene;
+}
 
-    context.buffers.scene_lights.gpu_buffer = context.device.create_buffer({
-        .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
-        .size = static_cast<u32>(context.buffers.scene_lights.cpu_buffer.size() * sizeof(SceneLights))
-    });
+void Renderer::swap_scene_data(std::unique_ptr<PreparedScene> prepared_scene)
+{
+    // only scene uploads are ever deferred, a scene which is still uploading is simply replaced
+    context.upload_ring.deferred_uploads.clear();
+    pending_scene = std::move(prepared_scene);
+    for(const auto & upload : pending_scene->uploads)
+    {
+        context.upload_ring.enqueue({
+            .data = pending_scene->upload_data,
+            .src_offset = upload.src_offset,
+            .dst_buffer = upload.dst_buffer,
+            .dst_offset = 0,
+            .size = upload.size,
+        });
+    }
+    DEBUG_OUT("[Renderer::swap_scene_data()] uploading " << pending_scene->upload_data->size() << " bytes of scene data");
+}
 
-    context.main_task_list.task_list.add_runtime_buffer(
-        context.main_task_list.buffers.t_scene_lights,
-        context.buffers.scene_lights.gpu_buffer);
+void Renderer::swap_pending_scene()
+{
+    auto & task_buffers = context.main_task_list.buffers;
+    auto swap_runtime_buffer = [&](daxa::TaskBufferId task_buffer, daxa::BufferId old_buffer, daxa::BufferId new_buffer)
+    {
+        if(context.device.is_id_valid(old_buffer))
+        {
+            context.main_task_list.task_list.remove_runtime_buffer(task_buffer, old_buffer);
+        }
+        context.main_task_list.task_list.add_runtime_buffer(task_buffer, new_buffer);
+    };
+
+    auto & old_buffers = context.scene_buffers;
+    auto & new_buffers = pending_scene->buffers;
+    swap_runtime_buffer(task_buffers.t_scene_vertices, old_buffers.vertices, new_buffers.vertices);
+    swap_runtime_buffer(task_buffers.t_scene_indices, old_buffers.indices, new_buffers.indices);
+    swap_runtime_buffer(task_buffers.t_scene_lights, old_buffers.lights, new_buffers.lights);
+    swap_runtime_buffer(task_buffers.t_scene_instances, old_buffers.instances, new_buffers.instances);
+    swap_runtime_buffer(task_buffers.t_instance_transforms, old_buffers.instance_transforms, new_buffers.instance_transforms);
+    swap_runtime_buffer(task_buffers.t_visible_instances, old_buffers.visible_instances, new_buffers.visible_instances);
+    swap_runtime_buffer(task_buffers.t_scene_meshes, old_buffers.meshes, new_buffers.meshes);
+    swap_runtime_buffer(task_buffers.t_scene_draws, old_buffers.draws, new_buffers.draws);
+    swap_runtime_buffer(task_buffers.t_draw_commands, old_buffers.draw_commands, new_buffers.draw_commands);
+    swap_runtime_buffer(task_buffers.t_draw_count, old_buffers.draw_count, new_buffers.draw_count);
+    swap_runtime_buffer(task_buffers.t_occluded_instances, old_buffers.occluded_instances, new_buffers.occluded_instances);
+    swap_runtime_buffer(task_buffers.t_static_draw_commands, old_buffers.static_draw_commands, new_buffers.static_draw_commands);
+    swap_runtime_buffer(task_buffers.t_static_visible_instances, old_buffers.static_visible_instances, new_buffers.static_visible_instances);
+
+    // the pending scene takes over the previous buffers and releases them when it is reset,
+    // the destruction is deferred by the device until the frames still using them have finished
+    std::swap(context.scene_buffers, pending_scene->buffers);
+    std::swap(context.render_info, pending_scene->render_info);
+    context.render_info.visible_draws.clear();
+    context.buffers.visible_instances.clear();
+    context.conditionals.hiz_valid = false;
+    context.conditionals.update_instance_transforms = true;
+    // with a still camera every tile would stay static and keep blending in the previous scene
+    context.conditionals.clear_accumulation = true;
+    context.conditionals.reset_taa_tiles = true;
+    pending_scene.reset();
+    DEBUG_OUT("[Renderer::swap_pending_scene()] scene swap successfull");
+}
 
-    context.conditionals.fill_scene_geometry = static_cast<u32>(true);
-    DEBUG_OUT("[Renderer::reload_scene_data()] scene reload successfull");
+void Renderer::reload_scene_data(const Scene & scene)
+{
+    swap_scene_data(prepare_scene_data(scene));
 }
 
 Renderer::~Renderer()
@@ -598,23 +1552,24 @@ Renderer::~Renderer()
     context.device.destroy_image(context.depth_image);
     context.device.destroy_image(context.offscreen_image_1);
     context.device.destroy_image(context.offscreen_image_2);
-    context.device.destroy_image(context.offscreen_copy_image);
+    context.device.destroy_image(context.taa_reference_image);
+    context.device.destroy_image(context.scene_color_image);
     context.device.destroy_image(context.velocity_image_1);
     context.device.destroy_image(context.velocity_image_2);
     context.device.destroy_buffer(context.buffers.transforms_buffer.gpu_buffer);
+    context.device.destroy_buffer(context.buffers.draw_count_readback);
+    context.device.destroy_buffer(context.buffers.fragment_count);
+    context.device.destroy_buffer(context.buffers.fragment_count_readback);
+    context.device.destroy_buffer(context.buffers.taa_tile_dispatches);
+    context.device.destroy_buffer(context.buffers.taa_tiles);
+    context.device.destroy_buffer(context.buffers.taa_tile_states);
+    context.device.destroy_buffer(context.buffers.taa_precision_diff_readback);
+    for(auto view : context.hiz_mip_views) { context.device.destroy_image_view(view); }
+    context.device.destroy_image(context.hiz_image);
     context.device.destroy_sampler(context.linear_sampler);
     context.device.destroy_sampler(context.nearest_sampler);
-    if(context.device.is_id_valid(context.buffers.scene_vertices.gpu_buffer))
-    {
-        context.device.destroy_buffer(context.buffers.scene_vertices.gpu_buffer);
-    }
-    if(context.device.is_id_valid(context.buffers.scene_lights.gpu_buffer))
-    {
-        context.device.destroy_buffer(context.buffers.scene_lights.gpu_buffer);
-    }
-    if(context.device.is_id_valid(context.buffers.scene_indices.gpu_buffer))
-    {
-        context.device.destroy_buffer(context.buffers.scene_indices.gpu_buffer);
-    }
+    destroy_scene_buffers(context.device, context.scene_buffers);
+    pending_scene.reset();
+    destroy_upload_ring(context.device, context.upload_ring);
     context.device.collect_garbage();
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <memory>
+
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_list.hpp>
 #include <daxa/utils/imgui.hpp>
@@ -12,10 +15,15 @@
 
 #include "tasks/fill_buffers_task.hpp"
 #include "tasks/init_accumulation_image.hpp"
+#include "tasks/update_instance_transforms_task.hpp"
+#include "tasks/cull_scene_task.hpp"
+#include "tasks/build_hiz_task.hpp"
 #include "tasks/draw_scene_task.hpp"
 #include "tasks/draw_debug_ligts.hpp"
 #include "tasks/draw_imgui_task.hpp"
 #include "tasks/taa_task.hpp"
+#include "tasks/resample_history.hpp"
+#include "tasks/image_diff.hpp"
 #include "tasks/tonemap_task.hpp"
 
 enum Define
@@ -25,26 +33,122 @@ enum Define
     REJECT_VELOCITY,
     REPROJECT_VELOCITY,
     NEAREST_DEPTH,
-    ACCUMULATE
+    ACCUMULATE,
+    COUNT_OVERDRAW,
+    DEPTH_VELOCITY,
+    // the TAA neighborhood footprint is 3x3 unless one of these is set, setting one clears the other
+    TAA_FOOTPRINT_PLUS,
+    TAA_FOOTPRINT_SEPARABLE
+};
+
+enum struct TAAFootprint
+{
+    SQUARE,
+    PLUS,
+    SEPARABLE,
+    COUNT
+};
+
+// Scene packed into its own set of GPU buffers, ready to be uploaded and swapped in by the renderer.
+// Buffers still owned by the prepared scene are released when it is destroyed.
+struct PreparedScene
+{
+    struct BufferUpload
+    {
+        daxa::BufferId dst_buffer;
+        u32 src_offset;
+        u32 size;
+    };
+
+    daxa::Device device;
+    RendererContext::SceneRenderInfo render_info;
+    RendererContext::SceneBuffers buffers;
+    // contents of all the buffers above packed back to back
+    std::shared_ptr<const std::vector<u8>> upload_data;
+    std::vector<BufferUpload> uploads;
+
+    explicit PreparedScene(daxa::Device device);
+    ~PreparedScene();
+
+    PreparedScene(const PreparedScene &) = delete;
+    PreparedScene & operator=(const PreparedScene &) = delete;
 };
 
 struct Renderer
 {
-    explicit Renderer(const AppWindow & window);
+    Renderer(const AppWindow & window, JobSystem & job_system);
     ~Renderer();
     f64 draw_time;
     f64 taa_time;
+    // FP16 against FP32 TAA output, only measured while the precisions are compared
+    f32 taa_precision_max_difference = 0.0f;
+    u32 taa_precision_differing_pixels = 0;
+    // smoothed taa_time of every footprint measured so far, zero until it was used
+    std::array<f64, static_cast<usize>(TAAFootprint::COUNT)> taa_footprint_time = {};
+    u64 drawn_triangles = 0;
+    u64 full_detail_triangles = 0;
+    u64 visible_instances = 0;
+    u64 culled_instances = 0;
+    // in the view frustum but hidden behind the depth of the previous and the current frame
+    u64 occluded_instances = 0;
+    u64 draw_calls = 0;
+    // shaded scene fragments per pixel, only measured with COUNT_OVERDRAW
+    f32 overdraw = 0.0f;
 
     void resize();
+    // fraction of the swapchain resolution the scene is rendered at, 0.5 to 1.0
+    void set_render_scale(f32 render_scale);
+    [[nodiscard]] auto get_render_scale() const -> f32;
+    // picks the render scale every frame so that the GPU frame time stays under budget_ms
+    void set_dynamic_resolution(bool enabled, f32 budget_ms);
     void draw(Camera & camera);
+    // safe to call from a worker thread while rendering, returns nullptr when the load got cancelled
+    [[nodiscard]] auto prepare_scene_data(const Scene & scene, SceneLoadProgress * progress = nullptr) -> std::unique_ptr<PreparedScene>;
+    // has to be called on the render thread between two frames. The prepared scene is streamed in over the
+    // next frames and replaces the current one at the first frame boundary after its upload finished.
+    void swap_scene_data(std::unique_ptr<PreparedScene> prepared_scene);
     void reload_scene_data(const Scene & scene);
     void change_shader_define(Define define, bool new_value);
+    void set_meshlet_cone_culling(bool enabled);
+    void set_gpu_culling(bool enabled);
+    void set_occlusion_culling(bool enabled);
+    void set_depth_prepass(bool enabled);
+    void set_lod_selection(bool enabled);
+    void set_static_batching(bool enabled);
+    void set_depth_sort(bool enabled);
+    // takes effect with the next reload_taa_pipeline
+    void set_taa_tile_size(u32 tile_size);
+    void set_taa_tile_classification(bool enabled);
+    void set_taa_fp16(bool enabled);
+    [[nodiscard]] auto is_taa_fp16_supported() const -> bool;
+    void set_taa_precision_comparison(bool enabled);
+    [[nodiscard]] auto get_taa_footprint() const -> TAAFootprint;
     void reload_taa_pipeline();
 
     private:
         RendererContext context;
+        // uploading scene, becomes the rendered scene once all of its data went through the upload ring
+        std::unique_ptr<PreparedScene> pending_scene;
+
+        struct DynamicResolution
+        {
+            bool enabled = false;
+            f32 budget_ms = 16.6f;
+            // consecutive frames which would have afforded a higher scale
+            u32 frames_under_budget = 0;
+            // the timestamps lag behind, measurements right after a change still belong to the old scale
+            u32 frames_since_change = 0;
+        };
+        DynamicResolution dynamic_resolution;
+        // the timestamps of the first frames after a footprint change still measure the previous one
+        u32 frames_since_footprint_change = 0;
 
         void create_main_task();
-        void create_resolution_dependent_resources();
+        // output_resolution also recreates the swapchain sized images, otherwise only the render sized ones
+        void create_resolution_dependent_resources(bool output_resolution);
+        void recreate_render_targets(bool output_resolution);
+        void update_dynamic_resolution(f64 gpu_frame_time);
+        void create_taa_pipelines();
         void swap_offscreen_images();
+        void swap_pending_scene();
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_list.hpp>
@@ -7,6 +8,11 @@
 
 #include "../types.hpp"
 #include "../scene.hpp"
+#include "../job_system.hpp"
+#include "../meshlet_builder.hpp"
+#include "upload_ring.hpp"
+#include "pipeline_cache.hpp"
+#include "scene_bvh.hpp"
 #include "../external/imgui_file_dialog.hpp"
 
 #include "shared/shared.inl"
@@ -23,9 +29,43 @@ struct RendererContext
         };
 
         SharedBuffer<TransformData> transforms_buffer;
-        SharedBuffer<std::vector<SceneGeometryVertices>> scene_vertices;
-        SharedBuffer<std::vector<SceneGeometryIndices>> scene_indices;
-        SharedBuffer<std::vector<SceneLights>> scene_lights;
+        // rewritten every frame from the culling results, the GPU buffer belongs to the scene buffers
+        std::vector<SceneVisibleInstances> visible_instances;
+        // host visible copies of the GPU culling draw count, one slot per upload ring segment
+        daxa::BufferId draw_count_readback;
+        // fragments shaded by the scene passes, only written while overdraw is counted
+        daxa::BufferId fragment_count;
+        daxa::BufferId fragment_count_readback;
+        // TAA tile classification, the tile lists and states are sized for the swapchain
+        daxa::BufferId taa_tile_dispatches;
+        daxa::BufferId taa_tiles;
+        daxa::BufferId taa_tile_states;
+        // one TAAPrecisionDiff per upload ring segment, written by the GPU while the precisions are compared
+        daxa::BufferId taa_precision_diff_readback;
+    };
+
+    // Static GPU data of one scene. A reload prepares a complete new set off the render thread which is
+    // streamed in through the upload ring and swapped in at a frame boundary once the upload finished,
+    // the previous set keeps being rendered until then.
+    struct SceneBuffers
+    {
+        daxa::BufferId vertices;
+        daxa::BufferId indices;
+        daxa::BufferId lights;
+        daxa::BufferId instances;
+        // model matrices premultiplied with the current and previous view projection
+        daxa::BufferId instance_transforms;
+        daxa::BufferId visible_instances;
+        // read by the GPU culling pass
+        daxa::BufferId meshes;
+        daxa::BufferId draws;
+        // written by the GPU culling passes, commands and visible instances hold two slots per instance - early and late pass
+        daxa::BufferId draw_commands;
+        daxa::BufferId draw_count;
+        daxa::BufferId occluded_instances;
+        // built once per scene for static batching - one full detail command per mesh covering all of its instances
+        daxa::BufferId static_draw_commands;
+        daxa::BufferId static_visible_instances;
     };
 
     struct MainTaskList
@@ -36,18 +76,34 @@ struct RendererContext
             daxa::TaskImageId t_prev_velocity_image;
             daxa::TaskImageId t_swapchain_image;
             daxa::TaskImageId t_offscreen_image;
-            daxa::TaskImageId t_offscreen_copy_image;
+            daxa::TaskImageId t_scene_color_image;
             daxa::TaskImageId t_accumulation_image;
             daxa::TaskImageId t_depth_image;
+            daxa::TaskImageId t_hiz_image;
+            daxa::TaskImageId t_taa_reference_image;
         };
 
         struct TaskListBuffers
         {
             daxa::TaskBufferId t_transform_data;
+            daxa::TaskBufferId t_fragment_count;
+            daxa::TaskBufferId t_taa_tile_dispatches;
+            daxa::TaskBufferId t_taa_tiles;
+            daxa::TaskBufferId t_taa_tile_states;
 
             daxa::TaskBufferId t_scene_vertices;
             daxa::TaskBufferId t_scene_indices;
             daxa::TaskBufferId t_scene_lights;
+            daxa::TaskBufferId t_scene_instances;
+            daxa::TaskBufferId t_instance_transforms;
+            daxa::TaskBufferId t_visible_instances;
+            daxa::TaskBufferId t_scene_meshes;
+            daxa::TaskBufferId t_scene_draws;
+            daxa::TaskBufferId t_draw_commands;
+            daxa::TaskBufferId t_draw_count;
+            daxa::TaskBufferId t_occluded_instances;
+            daxa::TaskBufferId t_static_draw_commands;
+            daxa::TaskBufferId t_static_visible_instances;
         };
 
         daxa::TaskList task_list;
@@ -64,57 +120,156 @@ struct RendererContext
 
     struct Pipelines
     {
+        std::shared_ptr<daxa::ComputePipeline> p_cull_scene;
+        std::shared_ptr<daxa::ComputePipeline> p_build_hiz;
+        std::shared_ptr<daxa::ComputePipeline> p_resample;
+        std::shared_ptr<daxa::ComputePipeline> p_update_instance_transforms;
         std::shared_ptr<daxa::RasterPipeline> p_draw_scene;
+        std::shared_ptr<daxa::RasterPipeline> p_draw_scene_depth;
+        std::shared_ptr<daxa::RasterPipeline> p_shade_scene;
         std::shared_ptr<daxa::RasterPipeline> p_draw_debug_lights;
         std::shared_ptr<daxa::ComputePipeline> p_taa_pass;
+        std::shared_ptr<daxa::ComputePipeline> p_taa_classify;
+        // full kernel in single precision without swapchain output, only used to compare against FP16
+        std::shared_ptr<daxa::ComputePipeline> p_taa_reference;
+        std::shared_ptr<daxa::ComputePipeline> p_image_diff;
+        // one resolve kernel per TAA_TILE_CLASS
+        std::array<std::shared_ptr<daxa::ComputePipeline>, TAA_TILE_CLASS_COUNT> p_taa_tiles;
         std::shared_ptr<daxa::RasterPipeline> p_tonemap_pass;
     };
 
     struct Conditionals
     {
         bool fill_transforms = true;
-        bool fill_scene_geometry = false;
+        bool fill_visible_instances = false;
+        // the view projection of this or the previous frame changed or a new scene was swapped in
+        bool update_instance_transforms = true;
         bool clear_accumulation = true;
 
         bool jitter_camera = true;
+        // otherwise the scene is culled on the CPU and drawn from render_info.visible_draws
+        bool gpu_culling = true;
+        // both only apply to GPU culling
+        bool occlusion_culling = true;
+        bool depth_prepass = false;
+        // the depth pyramid was built from the depth of the previous frame of the current scene
+        bool hiz_valid = false;
+        // The scene pipelines cull back faces, the cone test only skips meshlets made of nothing else. Meshlets
+        // are only culled on the CPU path and only for a mesh level with a single visible instance, instanced
+        // draws and everything culled on the GPU always draw whole levels
+        bool meshlet_cone_culling = true;
+        bool lod_selection = true;
+        // CPU path, draws front to back so that early depth testing rejects hidden fragments before shading
+        bool depth_sort = true;
+        bool count_overdraw = false;
+        // only applies to the CPU path, skips culling and draws the whole scene with the static draw commands
+        bool static_batching = false;
 
         bool color_clamp = true;
         bool velocity_rejection = true;
         bool velocity_reproject = true;
         bool nearest_depth = true;
         bool accumulate = true;
+        // the scene is static, TAA derives the camera motion from depth and the scene pass writes no velocity
+        bool depth_velocity = false;
+        // TAA neighborhood statistics over the plus shaped five texels or separably over 3x3, otherwise 3x3
+        bool taa_footprint_plus = false;
+        bool taa_footprint_separable = false;
+        // side of the square TAA workgroup, 8 or 16
+        u32 taa_tile_size = 8;
+        // resolve every tile with the kernel of its motion class instead of the full kernel everywhere
+        bool taa_tile_classification = true;
+        // the tile states were recreated or belong to a different tile grid
+        bool reset_taa_tiles = true;
+        // the dispatches only start from zero when the upload ring had space for the reset this frame
+        bool taa_tile_dispatches_reset = false;
+        // filter and blend the TAA colors in half precision, only ever set while taa_fp16_supported
+        bool taa_fp16 = false;
+        // additionally resolve in single precision every frame and diff the two outputs
+        bool compare_taa_precision = false;
+    };
+
+    // Camera state of the recorded frame used by the GPU culling pass
+    struct CullingParams
+    {
+        f32vec3 camera_position;
+        f32 lod_error_scale;
+        f32 lod_error_threshold;
     };
 
     // TODO(msakmary) perhaps reconsider moving this to Scene?
     struct SceneRenderInfo
     {
-        struct RenderMeshInfo
+        struct RenderMeshLod
         {
             u32 index_buffer_offset;
-            u32 index_offset;
             u32 index_count;
+            u32 first_meshlet;
+            u32 meshlet_count;
+            // mesh space simplification error of this level
+            f32 error;
         };
-        struct RenderObjectInfo
+        struct RenderMeshInfo
+        {
+            u32 index_offset;
+            // maps the stored (possibly quantized) vertex positions to mesh space
+            f32mat4x4 position_decode;
+            // all levels index into the same vertices, lods[0] is the full detail mesh
+            std::array<RenderMeshLod, MAX_MESH_LODS> lods;
+            u32 lod_count;
+            // mesh space bounding sphere and box, the box is empty for meshes without any triangles
+            f32vec3 bounds_center;
+            f32 bounds_radius;
+            Aabb bounds;
+        };
+        // object referencing a shared mesh, the index into instances matches the index into the GPU instance buffer
+        struct RenderInstanceInfo
         {
             f32mat4x4 model_transform;
-            std::vector<RenderMeshInfo> meshes;
+            u32 mesh_index;
+        };
+        // range of the scene index buffer drawn for a range of visible instances this frame
+        struct DrawRange
+        {
+            u32 mesh_index;
+            u32 first_index;
+            u32 index_count;
+            u32 first_instance;
+            u32 instance_count;
         };
 
-        std::vector<RenderObjectInfo> objects;
+        std::vector<RenderMeshInfo> meshes;
+        std::vector<RenderInstanceInfo> instances;
+        // built over the world space boxes of the instances, the BVH items are indices into instances
+        SceneBvh bvh;
+        u64 full_detail_triangles = 0;
+        // number of commands in the static draw commands buffer
+        u32 static_draw_count = 0;
+        u32 light_count = 0;
+        std::vector<Meshlet> meshlets;
+        std::vector<DrawRange> visible_draws;
     };
 
     daxa::Context vulkan_context;
     daxa::Device device;
     daxa::Swapchain swapchain;
-    daxa::PipelineManager pipeline_manager;
+    PipelineCache pipeline_cache;
 
     daxa::ImageId swapchain_image;
+    // the swapchain has an 8 bit UNORM format with storage usage, TAA writes the final output into it
+    bool storage_swapchain = false;
     daxa::ImageId offscreen_image_1;
     daxa::ImageId offscreen_image_2;
-    daxa::ImageId offscreen_copy_image;
+    // render resolution color of the scene, the TAA input
+    daxa::ImageId scene_color_image;
     daxa::ImageId velocity_image_1;
     daxa::ImageId velocity_image_2;
     daxa::ImageId depth_image;
+    daxa::ImageId hiz_image;
+    // single precision resolve compared against the half precision one, 1x1 unless compare_taa_precision
+    daxa::ImageId taa_reference_image;
+    // one storage view per pyramid level
+    std::array<daxa::ImageViewId, HIZ_MIP_COUNT> hiz_mip_views;
 
     daxa::SamplerId linear_sampler;
     daxa::SamplerId nearest_sampler;
@@ -122,14 +277,29 @@ struct RendererContext
     daxa::Format offscreen_format;
     daxa::Format velocity_format;
 
+    // the scene, its depth and velocity are rendered at render_scale of the swapchain extent,
+    // TAA reconstructs the full resolution output from them
+    f32 render_scale = 1.0f;
+    u32vec2 render_extent;
+    // tiles per class list, all tiles of the swapchain at the smallest tile size
+    u32 taa_tile_capacity = 0;
+    // The device is created by daxa which neither reports nor enables shaderFloat16, the half precision kernel
+    // would use a capability the device was not created with. Stays false until the device can be asked for it
+    bool taa_fp16_supported = false;
+
     daxa::ImGuiRenderer imgui_renderer;
 
     daxa::TimelineQueryPool timestamps;
 
+    JobSystem * job_system;
+    UploadRing upload_ring;
+
     Buffers buffers;
+    SceneBuffers scene_buffers;
     MainTaskList main_task_list;
     Pipelines pipelines;
 
     Conditionals conditionals;
+    CullingParams culling_params;
     SceneRenderInfo render_info;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "scene_bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+const u32 BVH_BIN_COUNT = 16u;
+// leaves are never split below this size, above it only when the SAH estimate says it pays off
+const u32 BVH_MIN_LEAF_ITEMS = 2u;
+const u32 BVH_MAX_LEAF_ITEMS = 8u;
+// cost of visiting a node relative to testing a single item
+const f32 BVH_TRAVERSAL_COST = 1.0f;
+
+static auto empty_aabb() -> Aabb
+{
+    return {
+        .min = f32vec3(std::numeric_limits<f32>::max()),
+        .max = f32vec3(std::numeric_limits<f32>::lowest())
+    };
+}
+
+auto Aabb::get_half_area() const -> f32
+{
+    if(is_empty()) { return 0.0f; }
+    f32vec3 extent = max - min;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+void Aabb::grow(const Aabb & other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+void Aabb::grow(const f32vec3 & point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+auto transform_aabb(const Aabb & box, const f32mat4x4 & transform) -> Aabb
+{
+    // Arvo - the extent along every world axis is the sum of the absolute projected box extents
+    f32vec3 center = f32vec3(transform * f32vec4((box.min + box.max) * 0.5f, 1.0f));
+    f32vec3 half_extent = (box.max - box.min) * 0.5f;
+    f32vec3 world_half_extent =
+        glm::abs(f32vec3(transform[0])) * half_extent.x +
+        glm::abs(f32vec3(transform[1])) * half_extent.y +
+        glm::abs(f32vec3(transform[2])) * half_extent.z;
+    return {.min = center - world_half_extent, .max = center + world_half_extent};
+}
+
+auto build_scene_bvh(std::span<const Aabb> bounds) -> SceneBvh
+{
+    SceneBvh bvh;
+    for(u32 item = 0; item < bounds.size(); item++)
+    {
+        if(!bounds[item].is_empty()) { bvh.item_indices.push_back(item); }
+    }
+    if(bvh.item_indices.empty()) { return bvh; }
+
+    auto get_centroid = [&](u32 item) -> f32vec3 { return (bounds[item].min + bounds[item].max) * 0.5f; };
+
+    bvh.nodes.reserve(2 * bvh.item_indices.size());
+    bvh.nodes.push_back({.first = 0, .count = static_cast<u32>(bvh.item_indices.size())});
+    std::vector<u32> build_stack = {0};
+    while(!build_stack.empty())
+    {
+        u32 node_idx = build_stack.back();
+        build_stack.pop_back();
+        u32 first = bvh.nodes[node_idx].first;
+        u32 count = bvh.nodes[node_idx].count;
+        auto items = std::span(bvh.item_indices).subspan(first, count);
+
+        Aabb node_bounds = empty_aabb();
+        Aabb centroid_bounds = empty_aabb();
+        for(u32 item : items)
+        {
+            node_bounds.grow(bounds[item]);
+            centroid_bounds.grow(get_centroid(item));
+        }
+        bvh.nodes[node_idx].bounds_min = node_bounds.min;
+        bvh.nodes[node_idx].bounds_max = node_bounds.max;
+        if(count <= BVH_MIN_LEAF_ITEMS) { continue; }
+
+        // evaluate the SAH at the bin boundaries of every axis
+        struct Bin
+        {
+            Aabb bounds = empty_aabb();
+            u32 count = 0;
+        };
+        f32 best_cost = std::numeric_limits<f32>::max();
+        u32 best_axis = 0;
+        u32 best_split = 0;
+        f32vec3 centroid_extent = centroid_bounds.max - centroid_bounds.min;
+        auto get_bin = [&](u32 item, u32 axis) -> u32
+        {
+            f32 relative = (get_centroid(item)[axis] - centroid_bounds.min[axis]) / centroid_extent[axis];
+            return glm::min(static_cast<u32>(relative * BVH_BIN_COUNT), BVH_BIN_COUNT - 1);
+        };
+        for(u32 axis = 0; axis < 3; axis++)
+        {
+            if(centroid_extent[axis] <= 0.0f) { continue; }
+
+            std::array<Bin, BVH_BIN_COUNT> bins = {};
+            for(u32 item : items)
+            {
+                auto & bin = bins[get_bin(item, axis)];
+                bin.bounds.grow(bounds[item]);
+                bin.count++;
+            }
+
+            // sweep from the right to get the cost of every right side, then from the left to combine them
+            std::array<f32, BVH_BIN_COUNT> right_costs = {};
+            Aabb right_bounds = empty_aabb();
+            u32 right_count = 0;
+            for(u32 bin = BVH_BIN_COUNT - 1; bin > 0; bin--)
+            {
+                right_bounds.grow(bins[bin].bounds);
+                right_count += bins[bin].count;
+                right_costs[bin] = right_bounds.get_half_area() * static_cast<f32>(right_count);
+            }
+            Aabb left_bounds = empty_aabb();
+            u32 left_count = 0;
+            for(u32 split = 1; split < BVH_BIN_COUNT; split++)
+            {
+                left_bounds.grow(bins[split - 1].bounds);
+                left_count += bins[split - 1].count;
+                if(left_count == 0 || left_count == count) { continue; }
+                f32 cost = left_bounds.get_half_area() * static_cast<f32>(left_count) + right_costs[split];
+                if(cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+
+        u32 left_count = 0;
+        if(best_split != 0)
+        {
+            f32 node_area = node_bounds.get_half_area();
+            f32 split_cost = BVH_TRAVERSAL_COST + (node_area > 0.0f ? best_cost / node_area : static_cast<f32>(count));
+            if(split_cost >= static_cast<f32>(count) && count <= BVH_MAX_LEAF_ITEMS) { continue; }
+
+            auto middle = std::partition(items.begin(), items.end(), [&](u32 item) { return get_bin(item, best_axis) < best_split; });
+            left_count = static_cast<u32>(middle - items.begin());
+        }
+        else
+        {
+            // all centroids coincide, the SAH can not separate them
+            if(count <= BVH_MAX_LEAF_ITEMS) { continue; }
+            left_count = count / 2;
+        }
+
+        auto child_idx = static_cast<u32>(bvh.nodes.size());
+        bvh.nodes.push_back({.first = first, .count = left_count});
+        bvh.nodes.push_back({.first = first + left_count, .count = count - left_count});
+        bvh.nodes[node_idx].first = child_idx;
+        bvh.nodes[node_idx].count = 0;
+        build_stack.push_back(child_idx);
+        build_stack.push_back(child_idx + 1);
+    }
+
+    bvh.item_bounds.reserve(bvh.item_indices.size());
+    for(u32 item : bvh.item_indices) { bvh.item_bounds.push_back(bounds[item]); }
+    return bvh;
+}
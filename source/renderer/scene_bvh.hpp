@@ -0,0 +1,45 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "../types.hpp"
+
+struct Aabb
+{
+    f32vec3 min;
+    f32vec3 max;
+
+    [[nodiscard]] auto is_empty() const -> bool { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    // half of the surface area, only ever used in ratios
+    [[nodiscard]] auto get_half_area() const -> f32;
+    void grow(const Aabb & other);
+    void grow(const f32vec3 & point);
+};
+
+// Bounds of box transformed by transform
+[[nodiscard]] auto transform_aabb(const Aabb & box, const f32mat4x4 & transform) -> Aabb;
+
+struct BvhNode
+{
+    f32vec3 bounds_min;
+    // index of the left child for inner nodes, the right child directly follows it.
+    // Index of the first item in SceneBvh::item_indices for leaves.
+    u32 first;
+    f32vec3 bounds_max;
+    // zero for inner nodes
+    u32 count;
+};
+
+// Bounding volume hierarchy over world space boxes, nodes[0] is the root
+struct SceneBvh
+{
+    std::vector<BvhNode> nodes;
+    // items ordered so that every leaf references a contiguous range
+    std::vector<u32> item_indices;
+    // bounds of the items in the order of item_indices
+    std::vector<Aabb> item_bounds;
+};
+
+// Top down binned SAH build, empty boxes are left out of the hierarchy
+[[nodiscard]] auto build_scene_bvh(std::span<const Aabb> bounds) -> SceneBvh;
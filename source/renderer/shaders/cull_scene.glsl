@@ -0,0 +1,119 @@
+#define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
+#define DAXA_ENABLE_IMAGE_OVERLOADS_BASIC 1
+#include <shared/shared.inl>
+
+DAXA_USE_PUSH_CONSTANT(CullScenePC)
+
+// Gribb-Hartmann plane extraction, expects zero to one depth range
+bool is_sphere_visible(f32mat4x4 m_proj_view, f32vec3 center, f32 radius)
+{
+    f32mat4x4 rows = transpose(m_proj_view);
+    f32vec4 planes[6] = f32vec4[6](
+        rows[3] + rows[0],
+        rows[3] - rows[0],
+        rows[3] + rows[1],
+        rows[3] - rows[1],
+        rows[2],
+        rows[3] - rows[2]
+    );
+    for(u32 plane = 0; plane < 6; plane++)
+    {
+        f32vec4 normalized = planes[plane] / length(planes[plane].xyz);
+        if(dot(normalized.xyz, center) + normalized.w < -radius) { return false; }
+    }
+    return true;
+}
+
+// Projects the box around the sphere and compares its nearest depth against the farthest
+// occluder depth of the pyramid level on which the projected rectangle spans at most 2x2 texels
+bool is_sphere_occluded(f32mat4x4 m_proj_view, f32vec3 center, f32 radius)
+{
+    f32vec2 uv_min = f32vec2(1.0);
+    f32vec2 uv_max = f32vec2(0.0);
+    f32 nearest_depth = 1.0;
+    for(u32 corner = 0; corner < 8; corner++)
+    {
+        f32vec3 offset = mix(f32vec3(-radius), f32vec3(radius), bvec3((corner & 1u) != 0, (corner & 2u) != 0, (corner & 4u) != 0));
+        f32vec4 clip = m_proj_view * f32vec4(center + offset, 1.0);
+        // bounds crossing the camera plane project to infinity, never occluded
+        if(clip.w <= 0.0) { return false; }
+        f32vec3 ndc = clip.xyz / clip.w;
+        uv_min = min(uv_min, ndc.xy * 0.5 + 0.5);
+        uv_max = max(uv_max, ndc.xy * 0.5 + 0.5);
+        nearest_depth = min(nearest_depth, ndc.z);
+    }
+    uv_min = clamp(uv_min, 0.0, 1.0);
+    uv_max = clamp(uv_max, 0.0, 1.0);
+
+    f32vec2 texel_extent = (uv_max - uv_min) * f32vec2(HIZ_WIDTH, HIZ_HEIGHT);
+    f32 level = min(ceil(log2(max(max(texel_extent.x, texel_extent.y), 1.0))), f32(HIZ_MIP_COUNT - 1));
+    f32 occluder_depth = max(
+        max(textureLod(daxa_push_constant.hiz_image, daxa_push_constant.nearest_sampler, uv_min, level).r,
+            textureLod(daxa_push_constant.hiz_image, daxa_push_constant.nearest_sampler, f32vec2(uv_max.x, uv_min.y), level).r),
+        max(textureLod(daxa_push_constant.hiz_image, daxa_push_constant.nearest_sampler, f32vec2(uv_min.x, uv_max.y), level).r,
+            textureLod(daxa_push_constant.hiz_image, daxa_push_constant.nearest_sampler, uv_max, level).r));
+    return nearest_depth > occluder_depth;
+}
+
+layout (local_size_x = CULL_SCENE_WORKGROUP_SIZE) in;
+void main()
+{
+    bool late_pass = daxa_push_constant.pass == CULL_PASS_LATE;
+    u32 draw_index = gl_GlobalInvocationID.x;
+    if(late_pass)
+    {
+        if(draw_index >= deref(daxa_push_constant.draw_count).occluded_count) { return; }
+        draw_index = deref(daxa_push_constant.occluded_instances[draw_index]).instance_index;
+    }
+    else if(draw_index >= daxa_push_constant.total_draw_count) { return; }
+
+    SceneDraws draw = deref(daxa_push_constant.draws[draw_index]);
+    SceneMeshes mesh = deref(daxa_push_constant.meshes[draw.mesh_index]);
+    if(mesh.lod_count == 0) { return; }
+    // occluded instances already passed the frustum test in the early pass
+    if(!late_pass && !is_sphere_visible(deref(daxa_push_constant.transforms).m_proj_view, draw.center, draw.radius)) { return; }
+
+    if(daxa_push_constant.occlusion_test != 0)
+    {
+        // the early pass tests against the pyramid of the previous frame, which was built with the previous camera
+        f32mat4x4 m_proj_view = late_pass ?
+            deref(daxa_push_constant.transforms).m_proj_view :
+            deref(daxa_push_constant.transforms).m_prev_proj_view;
+        if(is_sphere_occluded(m_proj_view, draw.center, draw.radius))
+        {
+            if(!late_pass)
+            {
+                u32 occluded_slot = atomicAdd(deref(daxa_push_constant.draw_count).occluded_count, 1);
+                deref(daxa_push_constant.occluded_instances[occluded_slot]).instance_index = draw_index;
+            }
+            return;
+        }
+    }
+
+    u32 lod = 0;
+    if(daxa_push_constant.lod_error_scale > 0.0)
+    {
+        // the closest point of the bounds gives a conservative estimate of the projected error
+        f32 distance = max(length(draw.center - daxa_push_constant.camera_position) - draw.radius, 0.1);
+        f32 error_to_pixels = draw.max_scale * daxa_push_constant.lod_error_scale / distance;
+        while(lod + 1 < mesh.lod_count && mesh.lod_error[lod + 1] * error_to_pixels <= daxa_push_constant.lod_error_threshold)
+        {
+            lod++;
+        }
+    }
+
+    u32 index_count = mesh.lod_index_count[lod];
+    u32 slot = late_pass ?
+        daxa_push_constant.total_draw_count + atomicAdd(deref(daxa_push_constant.draw_count).late_draw_count, 1) :
+        atomicAdd(deref(daxa_push_constant.draw_count).early_draw_count, 1);
+    atomicAdd(deref(daxa_push_constant.draw_count).triangle_count, index_count / 3);
+    // every surviving instance gets its own draw, the first instance points the vertex shader at the instance
+    deref(daxa_push_constant.visible_instances[slot]).instance_index = draw_index;
+    deref(daxa_push_constant.draw_commands[slot]) = SceneDrawCommands(
+        index_count,
+        1u,
+        mesh.lod_first_index[lod],
+        i32(mesh.vertex_offset),
+        slot
+    );
+}
@@ -0,0 +1,43 @@
+#define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
+#define DAXA_ENABLE_IMAGE_OVERLOADS_BASIC 1
+#include <shared/shared.inl>
+
+DAXA_USE_PUSH_CONSTANT(HizPC)
+
+// Every texel of the pyramid holds the farthest depth of the area it covers
+layout (local_size_x = HIZ_WORKGROUP_SIZE, local_size_y = HIZ_WORKGROUP_SIZE) in;
+void main()
+{
+    u32vec2 dst_xy = gl_GlobalInvocationID.xy;
+    if(dst_xy.x >= daxa_push_constant.dst_size.x || dst_xy.y >= daxa_push_constant.dst_size.y) { return; }
+
+    u32vec2 src_size = daxa_push_constant.src_size;
+    f32 farthest_depth = 0.0;
+    if(daxa_push_constant.from_depth != 0)
+    {
+        // the depth image is not a multiple of level 0, every texel covers all depth texels it touches
+        u32vec2 begin = (dst_xy * src_size) / daxa_push_constant.dst_size;
+        u32vec2 end = ((dst_xy + 1) * src_size + daxa_push_constant.dst_size - 1) / daxa_push_constant.dst_size;
+        for(u32 y = begin.y; y < end.y; y++)
+        {
+            for(u32 x = begin.x; x < end.x; x++)
+            {
+                f32vec2 uv = (f32vec2(x, y) + 0.5) / f32vec2(src_size);
+                farthest_depth = max(farthest_depth, texture(daxa_push_constant.depth_image, daxa_push_constant.nearest_sampler, uv).r);
+            }
+        }
+    }
+    else
+    {
+        // levels are powers of two, only the one texel high levels at the end repeat a row
+        for(u32 y = 0; y < 2; y++)
+        {
+            for(u32 x = 0; x < 2; x++)
+            {
+                i32vec2 src_xy = i32vec2(min(dst_xy * 2 + u32vec2(x, y), src_size - 1));
+                farthest_depth = max(farthest_depth, imageLoad(daxa_push_constant.src_mip, src_xy).r);
+            }
+        }
+    }
+    imageStore(daxa_push_constant.dst_mip, i32vec2(dst_xy), f32vec4(farthest_depth));
+}
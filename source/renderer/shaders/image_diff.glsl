@@ -0,0 +1,27 @@
+#define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
+#define DAXA_ENABLE_IMAGE_OVERLOADS_BASIC 1
+#include <shared/shared.inl>
+
+DAXA_USE_PUSH_CONSTANT(ImageDiffPC)
+
+layout (local_size_x = IMAGE_DIFF_WORKGROUP_SIZE, local_size_y = IMAGE_DIFF_WORKGROUP_SIZE) in;
+void main()
+{
+    if(gl_GlobalInvocationID.x >= daxa_push_constant.size.x ||
+       gl_GlobalInvocationID.y >= daxa_push_constant.size.y)
+    {
+        return;
+    }
+
+    i32vec2 xy = i32vec2(gl_GlobalInvocationID.xy);
+    f32vec3 value = imageLoad(daxa_push_constant.image, xy).rgb;
+    f32vec3 reference = imageLoad(daxa_push_constant.reference_image, xy).rgb;
+    f32vec3 difference = abs(value - reference);
+    f32 max_difference = max(difference.r, max(difference.g, difference.b));
+
+    atomicMax(deref(daxa_push_constant.diff).max_difference, floatBitsToUint(max_difference));
+    if(max_difference > 1.0 / 255.0)
+    {
+        atomicAdd(deref(daxa_push_constant.diff).differing_pixels, 1);
+    }
+}
@@ -0,0 +1,17 @@
+#define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
+#include <shared/shared.inl>
+
+DAXA_USE_PUSH_CONSTANT(UpdateInstanceTransformsPC)
+
+layout (local_size_x = INSTANCE_TRANSFORMS_WORKGROUP_SIZE) in;
+void main()
+{
+    u32 instance_index = gl_GlobalInvocationID.x;
+    if(instance_index >= daxa_push_constant.instance_count) { return; }
+
+    f32mat4x4 m_model = deref(daxa_push_constant.instances[instance_index]).m_model;
+    deref(daxa_push_constant.instance_transforms[instance_index]) = SceneInstanceTransforms(
+        deref(daxa_push_constant.transforms).m_proj_view * m_model,
+        deref(daxa_push_constant.transforms).m_prev_proj_view * m_model
+    );
+}
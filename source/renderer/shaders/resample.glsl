@@ -0,0 +1,19 @@
+#define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
+#define DAXA_ENABLE_IMAGE_OVERLOADS_BASIC 1
+#include <shared/shared.inl>
+
+DAXA_USE_PUSH_CONSTANT(ResamplePC)
+
+layout (local_size_x = RESAMPLE_WORKGROUP_SIZE, local_size_y = RESAMPLE_WORKGROUP_SIZE) in;
+void main()
+{
+    if(gl_GlobalInvocationID.x >= daxa_push_constant.dst_size.x ||
+       gl_GlobalInvocationID.y >= daxa_push_constant.dst_size.y)
+    {
+        return;
+    }
+
+    f32vec2 uv = (f32vec2(gl_GlobalInvocationID.xy) + 0.5) / f32vec2(daxa_push_constant.dst_size);
+    f32vec4 value = textureLod(daxa_push_constant.src_image, daxa_push_constant.linear_sampler, uv, 0);
+    imageStore(daxa_push_constant.dst_image, i32vec2(gl_GlobalInvocationID.xy), value);
+}
@@ -4,47 +4,96 @@
 DAXA_USE_PUSH_CONSTANT(DrawScenePC)
 daxa_BufferPtr(SceneGeometryVertices) scene_vertices = daxa_push_constant.vertices;
 daxa_BufferPtr(TransformData) camera_transforms = daxa_push_constant.transforms;
+daxa_BufferPtr(SceneInstanceTransforms) instance_transforms = daxa_push_constant.instance_transforms;
+daxa_BufferPtr(SceneVisibleInstances) visible_instances = daxa_push_constant.visible_instances;
 
 #if defined(_VERTEX)
 // ===================== VERTEX SHADER ===============================
+#if defined(COMPACT_VERTICES)
+// quantized positions are mapped back to mesh space by the instance m_model
+f32vec3 decode_position(SceneGeometryVertices vertex)
+{
+    return f32vec3(vertex.position_xy & 0xFFFFu, vertex.position_xy >> 16u, vertex.position_z & 0xFFFFu);
+}
+
+f32vec3 decode_normal(SceneGeometryVertices vertex)
+{
+    f32vec2 octahedral = unpackSnorm2x16(vertex.normal);
+    f32vec3 normal = f32vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+    f32 fold = max(-normal.z, 0.0);
+    normal.xy += mix(f32vec2(fold), f32vec2(-fold), greaterThanEqual(normal.xy, f32vec2(0.0)));
+    return normalize(normal);
+}
+#else
+f32vec3 decode_position(SceneGeometryVertices vertex) { return vertex.position; }
+f32vec3 decode_normal(SceneGeometryVertices vertex) { return vertex.normal; }
+#endif
+
+// the shading pass after a depth prepass relies on bit identical depth
+invariant gl_Position;
 layout (location = 0) out f32vec3 normal_out;
+#if !defined(DEPTH_VELOCITY)
 layout (location = 1) out f32vec4 prev_pos;
 layout (location = 2) out f32vec4 curr_pos;
+#endif
 void main()
 {
-    f32vec4 pre_trans_pos = f32vec4(deref(scene_vertices[gl_VertexIndex + daxa_push_constant.index_offset]).position, 1.0);
+    // gl_VertexIndex already includes the vertex offset of the mesh
+    SceneGeometryVertices vertex = deref(scene_vertices[gl_VertexIndex]);
+    f32vec4 pre_trans_pos = f32vec4(decode_position(vertex), 1.0);
 
-    f32mat4x4 m_curr_proj_view_model = deref(camera_transforms).m_proj_view * daxa_push_constant.m_model;
-    f32mat4x4 m_prev_proj_view_model = deref(camera_transforms).m_prev_proj_view * daxa_push_constant.m_model;
+    // gl_InstanceIndex already includes the first instance of the draw
+    u32 instance_index = deref(visible_instances[gl_InstanceIndex]).instance_index;
+    SceneInstanceTransforms instance = deref(instance_transforms[instance_index]);
 
+#if defined(DEPTH_VELOCITY)
+    f32vec4 curr_pos = instance.m_proj_view_model * pre_trans_pos;
+#else
+    curr_pos = instance.m_proj_view_model * pre_trans_pos;
+    prev_pos = instance.m_prev_proj_view_model * pre_trans_pos;
+#endif
 #if defined(JITTER_CAMERA)
-    gl_Position = deref(camera_transforms).m_jitter * m_curr_proj_view_model * pre_trans_pos;
+    gl_Position = deref(camera_transforms).m_jitter * curr_pos;
 #else
-    gl_Position = m_curr_proj_view_model * pre_trans_pos;
+    gl_Position = curr_pos;
 #endif
 
-    normal_out = deref(scene_vertices[gl_VertexIndex + daxa_push_constant.index_offset]).normal;
-    curr_pos = m_curr_proj_view_model * pre_trans_pos;
-    prev_pos = m_prev_proj_view_model * pre_trans_pos;
+    normal_out = decode_normal(vertex);
 }
 
+#elif defined(_FRAGMENT) && defined(DEPTH_ONLY)
+// ===================== DEPTH ONLY FRAGMENT SHADER ===============================
+void main() {}
+
 #elif defined(_FRAGMENT)
 // ===================== FRAGMENT SHADER ===============================
+#if defined(COUNT_OVERDRAW)
+// the counter is a side effect which would otherwise allow the depth test to run after the shader,
+// the shader neither discards nor writes depth so forcing the early test does not change the result
+layout (early_fragment_tests) in;
+#endif
 layout (location = 0) in f32vec3 normal_in;
+#if !defined(DEPTH_VELOCITY)
 layout (location = 1) in f32vec4 prev_pos;
 layout (location = 2) in f32vec4 curr_pos;
+#endif
 
 layout (location = 0) out f32vec4 out_color;
+#if !defined(DEPTH_VELOCITY)
 layout (location = 1) out f32vec4 out_velocity;
-layout (location = 2) out f32vec4 out_color_copy;
+#endif
 
 void main()
 {
+    out_color = f32vec4((normal_in + 1.0) / 2.0, 1.0);
+#if !defined(DEPTH_VELOCITY)
     f32vec2 prev_pos_div = f32vec2((prev_pos.xy / prev_pos.w) * 0.5 + 0.5);
     f32vec2 curr_pos_div = f32vec2((curr_pos.xy / curr_pos.w) * 0.5 + 0.5);
     f32vec2 velocity = curr_pos_div - prev_pos_div;
-    out_color = f32vec4((normal_in + 1.0) / 2.0, 1.0);
-    out_color_copy = f32vec4((normal_in + 1.0) / 2.0, 1.0);
     out_velocity = f32vec4(velocity, 0.0, 1.0);
+#endif
+#if defined(COUNT_OVERDRAW)
+    atomicAdd(deref(daxa_push_constant.fragment_count).fragment_count, 1);
+#endif
 }
 #endif
\ No newline at end of file
@@ -1,79 +1,392 @@
+#if defined(TAA_FP16)
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#endif
 #define DAXA_ENABLE_SHADER_NO_NAMESPACE 1
 #define DAXA_ENABLE_IMAGE_OVERLOADS_BASIC 1
 #include <shared/shared.inl>
 
 DAXA_USE_PUSH_CONSTANT(TAAPC)
-layout (local_size_x = 8, local_size_y = 4, local_size_z = 1) in;
+
+// square workgroup, every group resolves one tile and shares the neighborhood of the whole tile
+#if !defined(TAA_TILE_SIZE)
+#define TAA_TILE_SIZE 8
+#endif
+#define TAA_APRON_SIZE (TAA_TILE_SIZE + 2)
+#define TAA_APRON_TEXELS (TAA_APRON_SIZE * TAA_APRON_SIZE)
+
+// TAA_FP16 - colors are loaded, filtered and blended in half precision, the images are RGBA16F anyway.
+// Positions, uvs and velocities stay in full precision, half precision can not address a 4K image exactly
+#if defined(TAA_FP16)
+#define taa_float float16_t
+#define taa_vec4 f16vec4
+#else
+#define taa_float f32
+#define taa_vec4 f32vec4
+#endif
+// largest value of the RGBA16F inputs
+#define TAA_COLOR_MAX 65504.0
+
+layout (local_size_x = TAA_TILE_SIZE, local_size_y = TAA_TILE_SIZE, local_size_z = 1) in;
 daxa_BufferPtr(TransformData) camera_transforms = daxa_push_constant.transforms;
 
+// TAA_TILE_CLASS - resolves only the tiles of one class listed by the classification, see TAA_CLASSIFY below.
+// Static tiles are compiled without the neighborhood features and skip the apron entirely, their color clamp
+// only loads the four direct neighbors of the texel
+#if defined(TAA_TILE_CLASS) && TAA_TILE_CLASS == TAA_TILE_CLASS_STATIC
+#define TAA_STATIC_TILE
+#endif
+
+// TAA_UPSAMPLE - the scene is rendered at a lower resolution than the output, every output pixel
+// reconstructs its current color from the render texels around it weighted by their jittered positions
+#if (defined(NEAREST_DEPTH) || defined(COLOR_CLAMP) || defined(REJECT_VELOCITY) || defined(TAA_UPSAMPLE)) && !defined(TAA_STATIC_TILE)
+#define TAA_NEIGHBORHOOD
+// render texels under the tile with a one texel border, loaded once per group instead of nine times per thread.
+// For render scales up to one the texels under a tile never span more than the tile itself
+shared taa_vec4 shared_color[TAA_APRON_TEXELS];
+#if defined(NEAREST_DEPTH)
+shared f32 shared_depth[TAA_APRON_TEXELS];
+#endif
+
+void load_neighborhood_apron(i32vec2 apron_origin)
+{
+    i32vec2 max_xy = i32vec2(daxa_push_constant.render_dimensions) - 1;
+    for(u32 texel = gl_LocalInvocationIndex; texel < TAA_APRON_TEXELS; texel += TAA_TILE_SIZE * TAA_TILE_SIZE)
+    {
+        i32vec2 apron_xy = i32vec2(texel % TAA_APRON_SIZE, texel / TAA_APRON_SIZE);
+        i32vec2 load_xy = clamp(apron_origin + apron_xy, i32vec2(0), max_xy);
+        shared_color[texel] = taa_vec4(imageLoad(daxa_push_constant.scene_color_image, load_xy));
+#if defined(NEAREST_DEPTH)
+        f32vec2 load_uv = (f32vec2(load_xy) + 0.5) / f32vec2(daxa_push_constant.render_dimensions);
+        shared_depth[texel] = texture(daxa_push_constant.depth_image, daxa_push_constant.nearest_sampler, load_uv).r;
+#endif
+    }
+}
+
+// Footprint of the neighborhood statistics - the color bounds for clamping, the blur the velocity rejection falls back
+// to and the nearest depth search. The upsampling reconstruction always filters the full 3x3 neighborhood.
+// TAA_FOOTPRINT_PLUS      - the texel and its four direct neighbors
+// TAA_FOOTPRINT_SEPARABLE - 3x3, reduced over three texels of every apron row first and then over three of those rows
+// otherwise               - 3x3, every thread reads all nine texels
+// the plus comes first so that it is a prefix of the 3x3 taps
+const i32vec2 TAA_TAP_OFFSETS[9] = i32vec2[](
+    i32vec2( 0,  1), i32vec2( 1,  0), i32vec2( 0,  0), i32vec2(-1,  0), i32vec2( 0, -1),
+    i32vec2( 1,  1), i32vec2(-1,  1), i32vec2( 1, -1), i32vec2(-1, -1)
+);
+#if defined(TAA_FOOTPRINT_PLUS)
+#define TAA_STATISTICS_TAPS 5
+const f32 TAA_TAP_WEIGHTS[TAA_STATISTICS_TAPS] = f32[](
+    1.0/8.0, 1.0/8.0, 1.0/2.0, 1.0/8.0, 1.0/8.0
+);
+#else
+#define TAA_STATISTICS_TAPS 9
+const f32 TAA_TAP_WEIGHTS[TAA_STATISTICS_TAPS] = f32[](
+    1.0/8.0, 1.0/8.0, 1.0/4.0, 1.0/8.0, 1.0/8.0,
+    1.0/16.0, 1.0/16.0, 1.0/16.0, 1.0/16.0
+);
+#endif
+
+#if defined(TAA_FOOTPRINT_SEPARABLE)
+// statistics of every apron texel over itself and its left and right neighbor, the border columns stay unused
+shared taa_vec4 shared_row_min[TAA_APRON_TEXELS];
+shared taa_vec4 shared_row_max[TAA_APRON_TEXELS];
+shared taa_vec4 shared_row_blur[TAA_APRON_TEXELS];
+#if defined(NEAREST_DEPTH)
+shared f32 shared_row_depth[TAA_APRON_TEXELS];
+// horizontal offset of the nearest depth in the row
+shared i32 shared_row_depth_x[TAA_APRON_TEXELS];
+#endif
+
+void reduce_apron_rows()
+{
+    for(u32 texel = gl_LocalInvocationIndex; texel < TAA_APRON_TEXELS; texel += TAA_TILE_SIZE * TAA_TILE_SIZE)
+    {
+        u32 apron_x = texel % TAA_APRON_SIZE;
+        if(apron_x == 0 || apron_x == TAA_APRON_SIZE - 1) { continue; }
+        taa_vec4 left = shared_color[texel - 1];
+        taa_vec4 center = shared_color[texel];
+        taa_vec4 right = shared_color[texel + 1];
+        shared_row_min[texel] = min(min(left, center), right);
+        shared_row_max[texel] = max(max(left, center), right);
+        shared_row_blur[texel] = taa_float(0.25) * (left + right) + taa_float(0.5) * center;
+#if defined(NEAREST_DEPTH)
+        f32 row_depth = shared_depth[texel];
+        i32 row_depth_x = 0;
+        if(shared_depth[texel + 1] < row_depth) { row_depth = shared_depth[texel + 1]; row_depth_x = 1; }
+        if(shared_depth[texel - 1] < row_depth) { row_depth = shared_depth[texel - 1]; row_depth_x = -1; }
+        shared_row_depth[texel] = row_depth;
+        shared_row_depth_x[texel] = row_depth_x;
+#endif
+    }
+}
+#endif
+#endif
+
+// velocity in uv units from the previous to the current frame of the given render texel
+f32vec2 load_velocity(i32vec2 render_xy)
+{
+#if defined(DEPTH_VELOCITY)
+    // the scene is static, so all motion comes from the camera and follows from the depth
+    f32vec2 uv = (f32vec2(render_xy) + 0.5) / f32vec2(daxa_push_constant.render_dimensions);
+    f32 depth = texture(daxa_push_constant.depth_image, daxa_push_constant.nearest_sampler, uv).r;
+    // the depth was rasterized with the jitter applied, both matrices are without it
+    f32vec2 curr_ndc = uv * 2.0 - 1.0 - deref(camera_transforms).m_jitter[3].xy;
+    f32vec4 world_pos = deref(camera_transforms).m_inv_proj_view * f32vec4(curr_ndc, depth, 1.0);
+    f32vec4 prev_pos = deref(camera_transforms).m_prev_proj_view * f32vec4(world_pos.xyz / world_pos.w, 1.0);
+    return (curr_ndc - prev_pos.xy / prev_pos.w) * 0.5;
+#else
+    return imageLoad(daxa_push_constant.velocity_image, render_xy).rg;
+#endif
+}
+
+#if defined(TAA_OUTPUT_SWAPCHAIN)
+// the UNORM swapchain has no hardware encode, matches what tonemap.glsl gets from an sRGB swapchain
+f32vec3 linear_to_srgb(f32vec3 color)
+{
+    color = clamp(color, 0.0, 1.0);
+    return mix(color * 12.92, 1.055 * pow(color, f32vec3(1.0 / 2.4)) - 0.055, greaterThan(color, f32vec3(0.0031308)));
+}
+#endif
+
+#if defined(TAA_CLASSIFY)
+// ===================== TILE CLASSIFICATION ===============================
+// One group per tile, sorts the tile into the list of the cheapest kernel which still resolves it correctly:
+// static      - no motion for TAA_CONVERGED_FRAMES, the history at the same pixel is blended in without clamping
+// moving      - uniform motion, full reprojection and clamping
+// disoccluded - the motion differs within the tile or leaves the screen, additionally rejects by velocity
+shared u32 tile_max_speed;
+shared u32 tile_min_velocity_x;
+shared u32 tile_min_velocity_y;
+shared u32 tile_max_velocity_x;
+shared u32 tile_max_velocity_y;
+shared bool tile_leaves_screen;
+
+// order preserving mapping of floats to uints for the shared atomics
+u32 order_float(f32 value)
+{
+    u32 bits = floatBitsToUint(value);
+    return (bits & 0x80000000u) != 0 ? ~bits : bits | 0x80000000u;
+}
+
+f32 unorder_float(u32 bits)
+{
+    return uintBitsToFloat((bits & 0x80000000u) != 0 ? bits & 0x7FFFFFFFu : ~bits);
+}
+
 void main()
 {
-    if(gl_GlobalInvocationID.x >= daxa_push_constant.swapchain_dimensions.x ||
-       gl_GlobalInvocationID.y >= daxa_push_constant.swapchain_dimensions.y)
+    if(gl_LocalInvocationIndex == 0)
     {
-        return;
+        tile_max_speed = 0;
+        tile_min_velocity_x = 0xFFFFFFFFu;
+        tile_min_velocity_y = 0xFFFFFFFFu;
+        tile_max_velocity_x = 0;
+        tile_max_velocity_y = 0;
+        tile_leaves_screen = false;
+    }
+    barrier();
+
+    u32vec2 pixel_xy = gl_GlobalInvocationID.xy;
+    if(all(lessThan(pixel_xy, daxa_push_constant.swapchain_dimensions)))
+    {
+        f32vec2 in_uv = (f32vec2(pixel_xy) + 0.5) / f32vec2(daxa_push_constant.swapchain_dimensions);
+        f32vec2 velocity = load_velocity(i32vec2(floor(in_uv * f32vec2(daxa_push_constant.render_dimensions))));
+        f32vec2 velocity_px = velocity * f32vec2(daxa_push_constant.swapchain_dimensions);
+        atomicMax(tile_max_speed, order_float(length(velocity_px)));
+        atomicMin(tile_min_velocity_x, order_float(velocity_px.x));
+        atomicMin(tile_min_velocity_y, order_float(velocity_px.y));
+        atomicMax(tile_max_velocity_x, order_float(velocity_px.x));
+        atomicMax(tile_max_velocity_y, order_float(velocity_px.y));
+        f32vec2 prev_uv = in_uv + velocity;
+        if(any(lessThan(prev_uv, f32vec2(0.0))) || any(greaterThan(prev_uv, f32vec2(1.0)))) { tile_leaves_screen = true; }
     }
+    barrier();
+    if(gl_LocalInvocationIndex != 0) { return; }
 
-    i32vec2 thread_xy = i32vec2(gl_GlobalInvocationID.xy);
-    f32vec2 in_uv = f32vec2(thread_xy) / f32vec2(daxa_push_constant.swapchain_dimensions - u32vec2(1));
+    u32 state_index = gl_WorkGroupID.y * daxa_push_constant.tile_count.x + gl_WorkGroupID.x;
+    u32 static_frames = daxa_push_constant.reset_tiles != 0 ? 0 : deref(daxa_push_constant.tile_states[state_index]).static_frames;
 
-#if defined(NEAREST_DEPTH) || defined(COLOR_CLAMP) || defined(REJECT_VELOCITY)
-    f32vec4[9] neighbors;
-    f32[9] gauss_weights = f32[](
-        1.0/16.0, 1.0/8.0, 1.0/16.0, 
-        1.0/ 8.0, 1.0/4.0, 1.0/ 8.0,
-        1.0/16.0, 1.0/8.0, 1.0/16.0
-    );
+    f32vec2 velocity_spread = 
+        f32vec2(unorder_float(tile_max_velocity_x), unorder_float(tile_max_velocity_y)) -
+        f32vec2(unorder_float(tile_min_velocity_x), unorder_float(tile_min_velocity_y));
+    u32 tile_class = TAA_TILE_CLASS_MOVING;
+    if(tile_leaves_screen || length(velocity_spread) > 0.5)
+    {
+        tile_class = TAA_TILE_CLASS_DISOCCLUDED;
+        static_frames = 0;
+    }
+    else if(unorder_float(tile_max_speed) < 0.01)
+    {
+        static_frames = min(static_frames + 1, TAA_CONVERGED_FRAMES);
+        if(static_frames == TAA_CONVERGED_FRAMES && daxa_push_constant.first_frame == 0) { tile_class = TAA_TILE_CLASS_STATIC; }
+    }
+    else
+    {
+        static_frames = 0;
+    }
+    deref(daxa_push_constant.tile_states[state_index]).static_frames = static_frames;
 
-    f32vec4 blurred_col = f32vec4(0.0);
-    f32 closest_depth = 1.0;
-    i32vec2 depth_thread_xy = thread_xy;
+    u32 slot = atomicAdd(deref(daxa_push_constant.tile_dispatches[tile_class]).count, 1);
+    atomicMax(deref(daxa_push_constant.tile_dispatches[tile_class]).x, min(slot + 1, TAA_MAX_TILE_GROUPS_X));
+    atomicMax(deref(daxa_push_constant.tile_dispatches[tile_class]).y, slot / TAA_MAX_TILE_GROUPS_X + 1);
+    deref(daxa_push_constant.tiles[tile_class * daxa_push_constant.tile_capacity + slot]).packed_xy = gl_WorkGroupID.x | (gl_WorkGroupID.y << 16);
+}
 
-    f32vec4 min_color = f32vec4(10.0e5);
-    f32vec4 max_color = f32vec4(-10.0e5); 
-    for(i32 y = 1; y > -2; y--)
+#else
+// ===================== RESOLVE ===============================
+void main()
+{
+#if defined(TAA_TILE_CLASS)
+    u32 tile_index = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    // the whole group leaves before any barrier
+    if(tile_index >= deref(daxa_push_constant.tile_dispatches[TAA_TILE_CLASS]).count) { return; }
+    u32 packed_tile = deref(daxa_push_constant.tiles[TAA_TILE_CLASS * daxa_push_constant.tile_capacity + tile_index]).packed_xy;
+    u32vec2 tile_xy = u32vec2(packed_tile & 0xFFFFu, packed_tile >> 16);
+#else
+    u32vec2 tile_xy = gl_WorkGroupID.xy;
+#endif
+    i32vec2 thread_xy = i32vec2(tile_xy * TAA_TILE_SIZE + gl_LocalInvocationID.xy);
+    f32vec2 render_scale = f32vec2(daxa_push_constant.render_dimensions) / f32vec2(daxa_push_constant.swapchain_dimensions);
+#if defined(TAA_NEIGHBORHOOD)
+    // every thread of the group takes part in the load, out of bounds threads only leave after the barrier
+    f32vec2 tile_origin = f32vec2(tile_xy) * f32(TAA_TILE_SIZE);
+    i32vec2 apron_origin = i32vec2(floor((tile_origin + 0.5) * render_scale)) - 1;
+    load_neighborhood_apron(apron_origin);
+    barrier();
+#if defined(TAA_FOOTPRINT_SEPARABLE)
+    reduce_apron_rows();
+    barrier();
+#endif
+#endif
+
+    if(any(greaterThanEqual(u32vec2(thread_xy), daxa_push_constant.swapchain_dimensions)))
     {
-        for(i32 x = 1; x > -2; x--)
-        {
-            i32 index = ((y + 1) * 3) + (x + 1);
-            neighbors[index] = imageLoad(daxa_push_constant.offscreen_copy_image, thread_xy + i32vec2(x, y));
-            f32vec2 uv_offset = f32vec2(x,y) / f32vec2(daxa_push_constant.swapchain_dimensions);
-            f32 depth = texture(daxa_push_constant.depth_image, daxa_push_constant.nearest_sampler, in_uv + uv_offset).r;
+        return;
+    }
 
-            closest_depth = min(depth, closest_depth);
-            depth_thread_xy = i32(closest_depth == depth) * (thread_xy + i32vec2(x, y)) + i32(closest_depth != depth) * depth_thread_xy;
+    f32vec2 in_uv = (f32vec2(thread_xy) + 0.5) / f32vec2(daxa_push_constant.swapchain_dimensions);
+    // render texel under the center of this pixel, the pixel itself at full resolution
+    i32vec2 render_xy = i32vec2(floor(in_uv * f32vec2(daxa_push_constant.render_dimensions)));
 
-            min_color = min(neighbors[index], min_color);
-            max_color = max(neighbors[index], max_color);
+#if defined(TAA_NEIGHBORHOOD)
+    taa_vec4 blurred_col = taa_vec4(0.0);
+    f32 closest_depth = 1.0;
+    i32vec2 depth_thread_xy = render_xy;
+#if defined(TAA_UPSAMPLE)
+    // the jitter moved the geometry by this many render pixels, so every render texel saw the scene at its center minus it
+    f32vec2 jitter_px = f32vec2(deref(camera_transforms).m_jitter[3].xy) * f32vec2(daxa_push_constant.render_dimensions) * 0.5;
+    taa_vec4 upsampled_color = taa_vec4(0.0);
+    f32 total_weight = 0.0;
+    f32 max_weight = 0.0;
+#endif
 
-            blurred_col += gauss_weights[index] * neighbors[index];
-        } 
+    taa_vec4 min_color = taa_vec4(TAA_COLOR_MAX);
+    taa_vec4 max_color = taa_vec4(-TAA_COLOR_MAX);
+    // position of the render texel of this thread in the apron
+    i32vec2 apron_center = render_xy - apron_origin;
+#if defined(TAA_FOOTPRINT_SEPARABLE)
+    for(i32 y = 1; y > -2; y--)
+    {
+        i32 row_texel = (apron_center.y + y) * TAA_APRON_SIZE + apron_center.x;
+        min_color = min(shared_row_min[row_texel], min_color);
+        max_color = max(shared_row_max[row_texel], max_color);
+        blurred_col += taa_float(y == 0 ? 0.5 : 0.25) * shared_row_blur[row_texel];
+#if defined(NEAREST_DEPTH)
+        if(shared_row_depth[row_texel] < closest_depth)
+        {
+            closest_depth = shared_row_depth[row_texel];
+            depth_thread_xy = render_xy + i32vec2(shared_row_depth_x[row_texel], y);
+        }
+#endif
+    }
+#endif
+#if !defined(TAA_FOOTPRINT_SEPARABLE) || defined(TAA_UPSAMPLE)
+#if defined(TAA_UPSAMPLE)
+    // the reconstruction always filters all nine texels, the statistics only their footprint
+    const u32 tap_count = 9;
+#else
+    const u32 tap_count = TAA_STATISTICS_TAPS;
+#endif
+    for(u32 tap = 0; tap < tap_count; tap++)
+    {
+        i32vec2 offset = TAA_TAP_OFFSETS[tap];
+        i32vec2 apron_xy = apron_center + offset;
+        taa_vec4 neighbor = shared_color[apron_xy.y * TAA_APRON_SIZE + apron_xy.x];
+#if defined(TAA_UPSAMPLE)
+        // gaussian approximation of Blackman-Harris over the distance in output pixels
+        f32vec2 sample_offset = (f32vec2(render_xy + offset) + 0.5 - jitter_px) / render_scale - (f32vec2(thread_xy) + 0.5);
+        f32 sample_weight = exp(-2.29 * dot(sample_offset, sample_offset));
+        upsampled_color += taa_float(sample_weight) * neighbor;
+        total_weight += sample_weight;
+        max_weight = max(max_weight, sample_weight);
+#endif
+#if !defined(TAA_FOOTPRINT_SEPARABLE)
+        if(tap >= TAA_STATISTICS_TAPS) { continue; }
+#if defined(NEAREST_DEPTH)
+        f32 depth = shared_depth[apron_xy.y * TAA_APRON_SIZE + apron_xy.x];
+        closest_depth = min(depth, closest_depth);
+        depth_thread_xy = i32(closest_depth == depth) * (render_xy + offset) + i32(closest_depth != depth) * depth_thread_xy;
+#endif
+        min_color = min(neighbor, min_color);
+        max_color = max(neighbor, max_color);
+        blurred_col += taa_float(TAA_TAP_WEIGHTS[tap]) * neighbor;
+#endif
     }
+#endif
 
-    f32vec4 offscreen_color = neighbors[5];
+#if defined(TAA_UPSAMPLE)
+    // the weight sum goes below the smallest half precision normal
+    taa_vec4 offscreen_color = taa_vec4(f32vec4(upsampled_color) / max(total_weight, 1.0e-5));
+    // no sample landed close to this pixel this frame, lean on the history
+    f32 sample_confidence = max_weight;
+#else
+    taa_vec4 offscreen_color = shared_color[apron_center.y * TAA_APRON_SIZE + apron_center.x];
+    f32 sample_confidence = 1.0;
+#endif
 #else
-    f32vec4 offscreen_color = imageLoad(daxa_push_constant.offscreen_copy_image, thread_xy);
+    taa_vec4 offscreen_color = taa_vec4(imageLoad(daxa_push_constant.scene_color_image, render_xy));
+#if defined(COLOR_CLAMP)
+    taa_vec4 min_color = offscreen_color;
+    taa_vec4 max_color = offscreen_color;
+    i32vec2 max_render_xy = i32vec2(daxa_push_constant.render_dimensions) - 1;
+    // the first five taps are the plus, the center is the texel itself
+    for(u32 tap = 0; tap < 5; tap++)
+    {
+        if(tap == 2) { continue; }
+        i32vec2 load_xy = clamp(render_xy + TAA_TAP_OFFSETS[tap], i32vec2(0), max_render_xy);
+        taa_vec4 neighbor = taa_vec4(imageLoad(daxa_push_constant.scene_color_image, load_xy));
+        min_color = min(neighbor, min_color);
+        max_color = max(neighbor, max_color);
+    }
+#endif
+#if defined(TAA_UPSAMPLE)
+    // only the texel under the pixel, weighted the same way the full path weights its neighborhood
+    f32vec2 jitter_px = f32vec2(deref(camera_transforms).m_jitter[3].xy) * f32vec2(daxa_push_constant.render_dimensions) * 0.5;
+    f32vec2 sample_offset = (f32vec2(render_xy) + 0.5 - jitter_px) / render_scale - (f32vec2(thread_xy) + 0.5);
+    f32 sample_confidence = exp(-2.29 * dot(sample_offset, sample_offset));
+#else
+    f32 sample_confidence = 1.0;
+#endif
 #endif
 
 #if defined(NEAREST_DEPTH)
-    f32vec2 velocity = imageLoad(daxa_push_constant.velocity_image, depth_thread_xy).rg;
+    f32vec2 velocity = load_velocity(depth_thread_xy);
 #else
-    f32vec2 velocity = imageLoad(daxa_push_constant.velocity_image, thread_xy).rg;
+    f32vec2 velocity = load_velocity(render_xy);
 #endif
 
-    f32 accum_factor = max(0.1, f32(daxa_push_constant.first_frame));
+    taa_float accum_factor = taa_float(max(0.1 * sample_confidence, f32(daxa_push_constant.first_frame)));
 
 #if defined(REPROJECT_VELOCITY)
     f32vec2 vel_shift_uv = in_uv + velocity;
     i32vec2 accum_xy = i32vec2(vel_shift_uv * daxa_push_constant.swapchain_dimensions);
-    f32vec4 accumulation_color = imageLoad(daxa_push_constant.accumulation_image, accum_xy);
+    taa_vec4 accumulation_color = taa_vec4(imageLoad(daxa_push_constant.accumulation_image, accum_xy));
 
     if(vel_shift_uv.x < 0.0 || vel_shift_uv.x > 1.0 || vel_shift_uv.y < 0.0 || vel_shift_uv.y > 1.0)
     {
-        accum_factor = 1.0;
+        accum_factor = taa_float(1.0);
     }
 #else
-    f32vec4 accumulation_color = imageLoad(daxa_push_constant.accumulation_image, thread_xy);
+    taa_vec4 accumulation_color = taa_vec4(imageLoad(daxa_push_constant.accumulation_image, thread_xy));
 #endif
 
 #if defined(COLOR_CLAMP)
@@ -81,17 +394,21 @@ void main()
 #endif
 
 #if defined(ACCUMULATE)
-    f32vec4 out_color = offscreen_color * accum_factor + accumulation_color * (1 - accum_factor);
+    taa_vec4 out_color = offscreen_color * accum_factor + accumulation_color * (taa_float(1.0) - accum_factor);
 #else
-    f32vec4 out_color = offscreen_color;
+    taa_vec4 out_color = offscreen_color;
 #endif
 
 #if defined(REJECT_VELOCITY)
-    f32vec2 prev_velocity = imageLoad(daxa_push_constant.prev_velocity_image, accum_xy).rg;
+    f32vec2 prev_velocity = imageLoad(daxa_push_constant.prev_velocity_image, i32vec2(vel_shift_uv * daxa_push_constant.render_dimensions)).rg;
     f32 velocity_len = length(prev_velocity - velocity);
     f32 velocity_disocclusion = clamp((velocity_len - 0.001) * 10.0, 0.0, 1.0);
-    out_color = mix(out_color, blurred_col, velocity_disocclusion);
+    out_color = mix(out_color, blurred_col, taa_float(velocity_disocclusion));
 #endif
 
-    imageStore(daxa_push_constant.offscreen_image, thread_xy , out_color);
-}
\ No newline at end of file
+    imageStore(daxa_push_constant.offscreen_image, thread_xy , f32vec4(out_color));
+#if defined(TAA_OUTPUT_SWAPCHAIN)
+    imageStore(daxa_push_constant.swapchain_image, thread_xy, f32vec4(linear_to_srgb(f32vec3(out_color.rgb)), 1.0));
+#endif
+}
+#endif
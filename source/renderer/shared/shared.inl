@@ -16,28 +16,220 @@ struct SceneLights
     daxa_f32vec4 position;
 };
 
+#if defined(COMPACT_VERTICES)
+// 16 bit unorm position relative to the mesh AABB, the upper half of position_z is unused.
+// Normal octahedral encoded into 2x16 bit snorm
+struct SceneGeometryVertices
+{
+    daxa_u32 position_xy;
+    daxa_u32 position_z;
+    daxa_u32 normal;
+};
+#else
 struct SceneGeometryVertices
 {
     daxa_f32vec3 position;
     daxa_f32vec3 normal;
 };
+#endif
 
 struct SceneGeometryIndices
 {
     daxa_u32 index;
 };
 
+// One entry per object referencing a mesh, m_model also maps the stored vertex positions to mesh space
+struct SceneInstances
+{
+    daxa_f32mat4x4 m_model;
+};
+
+// Recomputed on the GPU whenever the camera moved, the vertex shader only does matrix vector products
+struct SceneInstanceTransforms
+{
+    daxa_f32mat4x4 m_proj_view_model;
+    daxa_f32mat4x4 m_prev_proj_view_model;
+};
+
+#define INSTANCE_TRANSFORMS_WORKGROUP_SIZE 64
+
+// Instances surviving culling grouped by the draw which renders them, indexed by gl_InstanceIndex
+struct SceneVisibleInstances
+{
+    daxa_u32 instance_index;
+};
+
+#define SCENE_MAX_MESH_LODS 5
+#define CULL_SCENE_WORKGROUP_SIZE 64
+// the early pass culls against the depth pyramid of the previous frame, the late pass retests what it rejected
+#define CULL_PASS_EARLY 0
+#define CULL_PASS_LATE 1
+
+// Depth pyramid resolution does not follow the swapchain, level 0 conservatively covers the whole depth image
+#define HIZ_WIDTH 512
+#define HIZ_HEIGHT 256
+#define HIZ_MIP_COUNT 10
+#define HIZ_WORKGROUP_SIZE 8
+
+// Static per mesh data read by the culling pass, lod_first_index and lod_index_count are ordered from full detail to coarsest
+struct SceneMeshes
+{
+    daxa_u32 vertex_offset;
+    daxa_u32 lod_count;
+    daxa_u32 lod_first_index[SCENE_MAX_MESH_LODS];
+    daxa_u32 lod_index_count[SCENE_MAX_MESH_LODS];
+    daxa_f32 lod_error[SCENE_MAX_MESH_LODS];
+};
+
+// One per instance with the same index, world space bounding sphere of the instance
+struct SceneDraws
+{
+    daxa_f32vec3 center;
+    daxa_f32 radius;
+    // largest axis scale of the instance transform
+    daxa_f32 max_scale;
+    daxa_u32 mesh_index;
+};
+
+// Same layout as VkDrawIndexedIndirectCommand
+struct SceneDrawCommands
+{
+    daxa_u32 index_count;
+    daxa_u32 instance_count;
+    daxa_u32 first_index;
+    daxa_i32 vertex_offset;
+    daxa_u32 first_instance;
+};
+
+struct SceneOccludedInstances
+{
+    daxa_u32 instance_index;
+};
+
+#define TAA_TILE_CLASS_STATIC 0
+#define TAA_TILE_CLASS_MOVING 1
+#define TAA_TILE_CLASS_DISOCCLUDED 2
+#define TAA_TILE_CLASS_COUNT 3
+// frames a tile has to stay still before its history counts as converged
+#define TAA_CONVERGED_FRAMES 16
+
+// guaranteed minimum of maxComputeWorkGroupCount, a 4K screen of 8x8 tiles has twice as many tiles
+#define TAA_MAX_TILE_GROUPS_X 65535
+
+// Indirect dispatch of the resolve kernel of one tile class. The classification appends to count and grows the
+// dispatch to rows of at most TAA_MAX_TILE_GROUPS_X groups, the groups of the last row past count return.
+struct TAATileDispatch
+{
+    daxa_u32 x;
+    daxa_u32 y;
+    daxa_u32 z;
+    daxa_u32 count;
+};
+
+// Tile coordinates packed as x | y << 16, the list of every class has room for all tiles of the screen
+struct TAATile
+{
+    daxa_u32 packed_xy;
+};
+
+// Persistent per tile, indexed by the tile position on screen
+struct TAATileState
+{
+    daxa_u32 static_frames;
+};
+
+// Difference between the resolves of the FP16 and the FP32 TAA kernel, written straight into host memory
+struct TAAPrecisionDiff
+{
+    // largest per channel difference as float bits, positive floats order like their bits
+    daxa_u32 max_difference;
+    // pixels which differ by more than one step of an 8 bit output
+    daxa_u32 differing_pixels;
+};
+
+// Early pass commands start at the beginning of the command buffer, late pass commands after one per instance
+struct SceneDrawCount
+{
+    daxa_u32 early_draw_count;
+    daxa_u32 late_draw_count;
+    // instances rejected by the early occlusion test, the late pass retests them
+    daxa_u32 occluded_count;
+    daxa_u32 triangle_count;
+};
+
+// Fragment shader invocations of the scene passes, only counted when the shaders are compiled with COUNT_OVERDRAW
+struct SceneFragmentCount
+{
+    daxa_u32 fragment_count;
+};
+
 DAXA_ENABLE_BUFFER_PTR(TransformData)
+DAXA_ENABLE_BUFFER_PTR(SceneFragmentCount)
 DAXA_ENABLE_BUFFER_PTR(SceneGeometryVertices)
 DAXA_ENABLE_BUFFER_PTR(SceneGeometryIndices)
 DAXA_ENABLE_BUFFER_PTR(SceneLights)
+DAXA_ENABLE_BUFFER_PTR(SceneInstances)
+DAXA_ENABLE_BUFFER_PTR(SceneInstanceTransforms)
+DAXA_ENABLE_BUFFER_PTR(SceneVisibleInstances)
+DAXA_ENABLE_BUFFER_PTR(SceneMeshes)
+DAXA_ENABLE_BUFFER_PTR(SceneDraws)
+DAXA_ENABLE_BUFFER_PTR(SceneDrawCommands)
+DAXA_ENABLE_BUFFER_PTR(SceneDrawCount)
+DAXA_ENABLE_BUFFER_PTR(SceneOccludedInstances)
+DAXA_ENABLE_BUFFER_PTR(TAATileDispatch)
+DAXA_ENABLE_BUFFER_PTR(TAATile)
+DAXA_ENABLE_BUFFER_PTR(TAATileState)
+DAXA_ENABLE_BUFFER_PTR(TAAPrecisionDiff)
 
+// Set once per pass, the object index of every vertex comes from gl_InstanceIndex
 struct DrawScenePC
 {
     daxa_BufferPtr(TransformData) transforms;
     daxa_BufferPtr(SceneGeometryVertices) vertices;
-    daxa_u32 index_offset;
-    daxa_f32mat4x4 m_model;
+    daxa_BufferPtr(SceneInstanceTransforms) instance_transforms;
+    daxa_BufferPtr(SceneVisibleInstances) visible_instances;
+    daxa_RWBufferPtr(SceneFragmentCount) fragment_count;
+};
+
+struct UpdateInstanceTransformsPC
+{
+    daxa_BufferPtr(TransformData) transforms;
+    daxa_BufferPtr(SceneInstances) instances;
+    daxa_RWBufferPtr(SceneInstanceTransforms) instance_transforms;
+    daxa_u32 instance_count;
+};
+
+struct CullScenePC
+{
+    daxa_BufferPtr(TransformData) transforms;
+    daxa_BufferPtr(SceneMeshes) meshes;
+    daxa_BufferPtr(SceneDraws) draws;
+    daxa_RWBufferPtr(SceneVisibleInstances) visible_instances;
+    daxa_RWBufferPtr(SceneDrawCommands) draw_commands;
+    daxa_RWBufferPtr(SceneDrawCount) draw_count;
+    daxa_RWBufferPtr(SceneOccludedInstances) occluded_instances;
+    daxa_Image2Df32 hiz_image;
+    daxa_SamplerId nearest_sampler;
+    daxa_f32vec3 camera_position;
+    // viewport height / (2 * tan(fov_y / 2)), zero disables the level of detail selection
+    daxa_f32 lod_error_scale;
+    daxa_f32 lod_error_threshold;
+    daxa_u32 total_draw_count;
+    daxa_u32 pass;
+    // zero when the depth pyramid holds nothing usable
+    daxa_u32 occlusion_test;
+};
+
+struct HizPC
+{
+    daxa_Image2Df32 depth_image;
+    daxa_SamplerId nearest_sampler;
+    daxa_RWImage2Df32 src_mip;
+    daxa_RWImage2Df32 dst_mip;
+    daxa_u32vec2 src_size;
+    daxa_u32vec2 dst_size;
+    // level 0 is reduced from the depth image instead of src_mip
+    daxa_u32 from_depth;
 };
 
 struct DrawDebugLightsPC
@@ -52,16 +244,51 @@ struct TonemapPC
     daxa_SamplerId linear_sampler;
 };
 
+#define RESAMPLE_WORKGROUP_SIZE 8
+
+// Bilinear copy of a history image into its replacement of a different size
+struct ResamplePC
+{
+    daxa_Image2Df32 src_image;
+    daxa_RWImage2Df32 dst_image;
+    daxa_SamplerId linear_sampler;
+    daxa_u32vec2 dst_size;
+};
+
+#define IMAGE_DIFF_WORKGROUP_SIZE 8
+
+// Per pixel comparison of two images of the same size
+struct ImageDiffPC
+{
+    daxa_RWImage2Df32 image;
+    daxa_RWImage2Df32 reference_image;
+    daxa_RWBufferPtr(TAAPrecisionDiff) diff;
+    daxa_u32vec2 size;
+};
+
 struct TAAPC
 {
     daxa_BufferPtr(TransformData) transforms;
     daxa_Image2Df32 depth_image;
+    // resolved output, the history of the next frame
     daxa_RWImage2Df32 offscreen_image;
-    daxa_RWImage2Df32 offscreen_copy_image;
+    daxa_RWImage2Df32 scene_color_image;
+    // only written with TAA_OUTPUT_SWAPCHAIN
+    daxa_RWImage2Df32 swapchain_image;
     daxa_RWImage2Df32 velocity_image;
     daxa_RWImage2Df32 prev_velocity_image;
     daxa_RWImage2Df32 accumulation_image;
     daxa_SamplerId nearest_sampler;
     daxa_u32vec2 swapchain_dimensions;
+    // of the scene images, smaller than the swapchain when upsampling
+    daxa_u32vec2 render_dimensions;
     daxa_u32 first_frame;
+    // only used with tile classification
+    daxa_RWBufferPtr(TAATileDispatch) tile_dispatches;
+    daxa_RWBufferPtr(TAATile) tiles;
+    daxa_RWBufferPtr(TAATileState) tile_states;
+    daxa_u32vec2 tile_count;
+    daxa_u32 tile_capacity;
+    // the tile states belong to another tile grid
+    daxa_u32 reset_tiles;
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/task_list.hpp>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
+#include "../shared/shared.inl"
+
+inline auto get_build_hiz_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo
+{
+    return {
+        .shader_info = {
+            .source = daxa::ShaderFile{"hiz.glsl"},
+        },
+        .push_constant_size = sizeof(HizPC),
+        .debug_name = "build hiz pipeline"
+    };
+}
+
+// Reduces the current depth into the depth pyramid one level at a time, only runs with occlusion culling enabled
+inline void task_build_hiz(RendererContext & context)
+{
+    context.main_task_list.task_list.add_task({
+        .used_images =
+        {
+            {
+                context.main_task_list.images.t_depth_image,
+                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+                daxa::ImageMipArraySlice{.image_aspect = daxa::ImageAspectFlagBits::DEPTH}
+            },
+            {
+                context.main_task_list.images.t_hiz_image,
+                daxa::TaskImageAccess::COMPUTE_SHADER_READ_WRITE,
+                daxa::ImageMipArraySlice{.level_count = HIZ_MIP_COUNT}
+            },
+        },
+        .task = [&](daxa::TaskRuntime const & runtime)
+        {
+            if(!context.conditionals.gpu_culling || !context.conditionals.occlusion_culling) { return; }
+
+            auto cmd_list = runtime.get_command_list();
+            auto depth_image = runtime.get_images(context.main_task_list.images.t_depth_image);
+            auto extent = context.render_extent;
+
+            cmd_list.set_pipeline(*context.pipelines.p_build_hiz);
+            u32vec2 src_size = {extent.x, extent.y};
+            u32vec2 dst_size = {HIZ_WIDTH, HIZ_HEIGHT};
+            for(u32 mip = 0; mip < HIZ_MIP_COUNT; mip++)
+            {
+                if(mip > 0)
+                {
+                    cmd_list.pipeline_barrier({
+                        .awaited_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_WRITE,
+                        .waiting_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_READ,
+                    });
+                }
+                cmd_list.push_constant(HizPC{
+                    .depth_image = depth_image[0].default_view(),
+                    .nearest_sampler = context.nearest_sampler,
+                    .src_mip = context.hiz_mip_views[mip > 0 ? mip - 1 : 0],
+                    .dst_mip = context.hiz_mip_views[mip],
+                    .src_size = {src_size.x, src_size.y},
+                    .dst_size = {dst_size.x, dst_size.y},
+                    .from_depth = mip == 0 ? 1u : 0u,
+                });
+                cmd_list.dispatch(
+                    (dst_size.x + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE,
+                    (dst_size.y + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE);
+                src_size = dst_size;
+                dst_size = glm::max(dst_size / 2u, u32vec2(1u));
+            }
+        },
+        .debug_name = "build hiz",
+    });
+}
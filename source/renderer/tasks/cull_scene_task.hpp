@@ -0,0 +1,150 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/task_list.hpp>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
+#include "../shared/shared.inl"
+
+inline auto get_cull_scene_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo
+{
+    return {
+        .shader_info = {
+            .source = daxa::ShaderFile{"cull_scene.glsl"},
+        },
+        .push_constant_size = sizeof(CullScenePC),
+        .debug_name = "cull scene pipeline"
+    };
+}
+
+// Frustum culls and selects the level of detail of every instance on the GPU, the survivors are compacted
+// into one indirect draw command each which task_draw_scene then draws with a single indirect count draw.
+// With occlusion culling the early pass also tests against the depth pyramid of the previous frame and
+// the late pass retests the rejected instances against the pyramid built from the early pass depth.
+inline void task_cull_scene(RendererContext & context, u32 pass)
+{
+    context.main_task_list.task_list.add_task({
+        .used_buffers =
+        {
+            {
+                context.main_task_list.buffers.t_transform_data,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_scene_meshes,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_scene_draws,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_visible_instances,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_draw_commands,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_draw_count,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_occluded_instances,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE,
+            },
+        },
+        .used_images =
+        {
+            {
+                context.main_task_list.images.t_hiz_image,
+                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+                daxa::ImageMipArraySlice{.level_count = HIZ_MIP_COUNT}
+            },
+        },
+        .task = [&, pass](daxa::TaskRuntime const & runtime)
+        {
+            auto total_draw_count = static_cast<u32>(context.render_info.instances.size());
+            if(!context.conditionals.gpu_culling || total_draw_count == 0) { return; }
+            if(pass == CULL_PASS_LATE && !context.conditionals.occlusion_culling) { return; }
+
+            auto cmd_list = runtime.get_command_list();
+            auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
+            auto meshes_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_meshes);
+            auto draws_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_draws);
+            auto visible_instances_buffer = runtime.get_buffers(context.main_task_list.buffers.t_visible_instances);
+            auto draw_commands_buffer = runtime.get_buffers(context.main_task_list.buffers.t_draw_commands);
+            auto draw_count_buffer = runtime.get_buffers(context.main_task_list.buffers.t_draw_count);
+            auto occluded_instances_buffer = runtime.get_buffers(context.main_task_list.buffers.t_occluded_instances);
+            auto hiz_image = runtime.get_images(context.main_task_list.images.t_hiz_image);
+            // the late pass always has the pyramid of the current frame
+            bool occlusion_test = context.conditionals.occlusion_culling && (pass == CULL_PASS_LATE || context.conditionals.hiz_valid);
+
+            const auto & params = context.culling_params;
+            cmd_list.set_pipeline(*context.pipelines.p_cull_scene);
+            cmd_list.push_constant(CullScenePC{
+                .transforms = context.device.get_device_address(transforms_buffer[0]),
+                .meshes = context.device.get_device_address(meshes_buffer[0]),
+                .draws = context.device.get_device_address(draws_buffer[0]),
+                .visible_instances = context.device.get_device_address(visible_instances_buffer[0]),
+                .draw_commands = context.device.get_device_address(draw_commands_buffer[0]),
+                .draw_count = context.device.get_device_address(draw_count_buffer[0]),
+                .occluded_instances = context.device.get_device_address(occluded_instances_buffer[0]),
+                .hiz_image = hiz_image[0].default_view(),
+                .nearest_sampler = context.nearest_sampler,
+                .camera_position = daxa_vec3_from_glm(params.camera_position),
+                .lod_error_scale = context.conditionals.lod_selection ? params.lod_error_scale : 0.0f,
+                .lod_error_threshold = params.lod_error_threshold,
+                .total_draw_count = total_draw_count,
+                .pass = pass,
+                .occlusion_test = occlusion_test ? 1u : 0u,
+            });
+            cmd_list.dispatch((total_draw_count + CULL_SCENE_WORKGROUP_SIZE - 1) / CULL_SCENE_WORKGROUP_SIZE);
+        },
+        .debug_name = pass == CULL_PASS_EARLY ? "cull scene early" : "cull scene late",
+    });
+}
+
+// Copies the draw count and the fragment count into the readback slots of the current upload ring segment for the statistics
+inline void task_read_back_statistics(RendererContext & context)
+{
+    context.main_task_list.task_list.add_task({
+        .used_buffers =
+        {
+            {
+                context.main_task_list.buffers.t_draw_count,
+                daxa::TaskBufferAccess::TRANSFER_READ,
+            },
+            {
+                context.main_task_list.buffers.t_fragment_count,
+                daxa::TaskBufferAccess::TRANSFER_READ,
+            },
+        },
+        .task = [&](daxa::TaskRuntime const & runtime)
+        {
+            auto cmd_list = runtime.get_command_list();
+            if(context.conditionals.count_overdraw)
+            {
+                auto fragment_count_buffer = runtime.get_buffers(context.main_task_list.buffers.t_fragment_count);
+                cmd_list.copy_buffer_to_buffer({
+                    .src_buffer = fragment_count_buffer[0],
+                    .dst_buffer = context.buffers.fragment_count_readback,
+                    .dst_offset = sizeof(SceneFragmentCount) * context.upload_ring.segment_index,
+                    .size = sizeof(SceneFragmentCount),
+                });
+            }
+            if(!context.conditionals.gpu_culling || context.render_info.instances.empty()) { return; }
+
+            auto draw_count_buffer = runtime.get_buffers(context.main_task_list.buffers.t_draw_count);
+            cmd_list.copy_buffer_to_buffer({
+                .src_buffer = draw_count_buffer[0],
+                .dst_buffer = context.buffers.draw_count_readback,
+                .dst_offset = sizeof(SceneDrawCount) * context.upload_ring.segment_index,
+                .size = sizeof(SceneDrawCount),
+            });
+        },
+        .debug_name = "read back statistics",
+    });
+}
@@ -61,7 +61,7 @@ inline void task_draw_debug_ligts(RendererContext & context)
         .used_images =
         {
             { 
-                context.main_task_list.images.t_offscreen_image,
+                context.main_task_list.images.t_scene_color_image,
                 daxa::TaskImageAccess::SHADER_WRITE_ONLY,
                 daxa::ImageMipArraySlice{} 
             },
@@ -73,10 +73,10 @@ inline void task_draw_debug_ligts(RendererContext & context)
         },
         .task = [&](daxa::TaskRuntime const & runtime)
         {
-            if(context.buffers.scene_lights.cpu_buffer.empty()) { return; }
+            if(context.render_info.light_count == 0) { return; }
             auto cmd_list = runtime.get_command_list();
-            auto dimensions = context.swapchain.get_surface_extent();
-            auto backbuffer_image = runtime.get_images(context.main_task_list.images.t_offscreen_image);
+            auto dimensions = context.render_extent;
+            auto backbuffer_image = runtime.get_images(context.main_task_list.images.t_scene_color_image);
             auto depth_image = runtime.get_images(context.main_task_list.images.t_depth_image);
             auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
             auto lights_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_lights);
@@ -101,7 +101,7 @@ inline void task_draw_debug_ligts(RendererContext & context)
                 .transforms = context.device.get_device_address(transforms_buffer[0]),
                 .lights = context.device.get_device_address(lights_buffer[0])
             });
-            cmd_list.draw({ .vertex_count = static_cast<u32>(context.buffers.scene_lights.cpu_buffer.size()) });
+            cmd_list.draw({ .vertex_count = context.render_info.light_count });
             cmd_list.end_renderpass();
         },
         .debug_name = "draw debug lights"
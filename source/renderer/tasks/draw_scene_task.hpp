@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <span>
+#include <vector>
 
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_list.hpp>
@@ -10,11 +12,40 @@
 #include "../renderer_context.hpp"
 #include "../shared/shared.inl"
 
-inline auto get_draw_scene_pipeline(const RendererContext & context) -> daxa::RasterPipelineCompileInfo
+enum struct ScenePipeline
+{
+    // color, velocity and depth
+    FULL,
+    // depth prepass
+    DEPTH_ONLY,
+    // color and velocity on top of the prepass depth
+    SHADE,
+};
+
+inline auto get_draw_scene_pipeline(const RendererContext & context, ScenePipeline kind = ScenePipeline::FULL) -> daxa::RasterPipelineCompileInfo
 {
     daxa::ShaderCompileOptions compile_options;
     compile_options.defines.push_back({"_VERTEX", ""});
     if(context.conditionals.jitter_camera) { compile_options.defines.push_back({"JITTER_CAMERA", ""}); }
+    if(context.conditionals.depth_velocity) { compile_options.defines.push_back({"DEPTH_VELOCITY", ""}); }
+
+    daxa::ShaderCompileOptions fragment_compile_options;
+    fragment_compile_options.defines.push_back({"_FRAGMENT", ""});
+    if(context.conditionals.depth_velocity) { fragment_compile_options.defines.push_back({"DEPTH_VELOCITY", ""}); }
+    std::vector<daxa::RenderAttachment> color_attachments;
+    if(kind == ScenePipeline::DEPTH_ONLY)
+    {
+        fragment_compile_options.defines.push_back({"DEPTH_ONLY", ""});
+    } else {
+        if(context.conditionals.count_overdraw) { fragment_compile_options.defines.push_back({"COUNT_OVERDRAW", ""}); }
+        color_attachments = {
+            daxa::RenderAttachment{ .format = context.offscreen_format, }, // Scene color image
+        };
+        if(!context.conditionals.depth_velocity)
+        {
+            color_attachments.push_back(daxa::RenderAttachment{ .format = context.velocity_format, }); // Velocity image
+        }
+    }
 
     return {
         .vertex_shader_info = {
@@ -23,30 +54,51 @@ inline auto get_draw_scene_pipeline(const RendererContext & context) -> daxa::Ra
             },
         .fragment_shader_info = {
             .source = daxa::ShaderFile{"scene.glsl"},
-            .compile_options = {
-                .defines = {{"_FRAGMENT", ""}},
-            },
-        },
-        .color_attachments = {
-            daxa::RenderAttachment{ .format = context.offscreen_format, }, // Offscreen image
-            daxa::RenderAttachment{ .format = context.velocity_format,  }, // Velocity image
-            daxa::RenderAttachment{ .format = context.offscreen_format, }, // Offscreen copy image
+            .compile_options = fragment_compile_options,
         },
+        .color_attachments = color_attachments,
+        // the shading pass only passes fragments matching the prepass depth, which uses the same vertex shader
         .depth_test = {
             .depth_attachment_format = daxa::Format::D32_SFLOAT,
             .enable_depth_test = true,
-            .enable_depth_write = true,
+            .enable_depth_write = kind != ScenePipeline::SHADE,
+            .depth_test_compare_op = daxa::CompareOp::LESS_OR_EQUAL,
         },
+        // meshes wind counter clockwise, which the flipped projection y keeps counter clockwise on screen.
+        // Back faces are culled, the meshlet cone test relies on them never being visible
         .raster = {
             .primitive_topology = daxa::PrimitiveTopology::TRIANGLE_LIST,
             .primitive_restart_enable = false,
-            .polygon_mode = daxa::PolygonMode::FILL
+            .polygon_mode = daxa::PolygonMode::FILL,
+            .face_culling = daxa::FaceCullFlagBits::BACK_BIT,
+            .front_face_winding = daxa::FrontFaceWinding::COUNTER_CLOCKWISE,
         },
         .push_constant_size = sizeof(DrawScenePC),
     };
 }
 
-inline void task_draw_scene(RendererContext & context)
+enum struct ScenePass
+{
+    // draws what the early culling pass accepted, clears all attachments
+    EARLY,
+    // draws what the late culling pass accepted on top
+    LATE,
+    // shades the depth of the two passes above when they only wrote depth
+    SHADE,
+};
+
+inline auto is_scene_pass_active(const RendererContext & context, ScenePass pass) -> bool
+{
+    switch(pass)
+    {
+        case ScenePass::EARLY: { return true; }
+        case ScenePass::LATE: { return context.conditionals.gpu_culling && context.conditionals.occlusion_culling; }
+        case ScenePass::SHADE: { return context.conditionals.gpu_culling && context.conditionals.depth_prepass; }
+    }
+    return false;
+}
+
+inline void task_draw_scene(RendererContext & context, ScenePass pass)
 {
     context.main_task_list.task_list.add_task({
         .used_buffers =
@@ -63,11 +115,39 @@ inline void task_draw_scene(RendererContext & context)
                 context.main_task_list.buffers.t_transform_data,
                 daxa::TaskBufferAccess::SHADER_READ_ONLY,
             },
+            {
+                context.main_task_list.buffers.t_instance_transforms,
+                daxa::TaskBufferAccess::SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_visible_instances,
+                daxa::TaskBufferAccess::SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_static_visible_instances,
+                daxa::TaskBufferAccess::SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_static_draw_commands,
+                daxa::TaskBufferAccess::DRAW_INDIRECT_INFO_READ,
+            },
+            {
+                context.main_task_list.buffers.t_fragment_count,
+                daxa::TaskBufferAccess::FRAGMENT_SHADER_READ_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_draw_commands,
+                daxa::TaskBufferAccess::DRAW_INDIRECT_INFO_READ,
+            },
+            {
+                context.main_task_list.buffers.t_draw_count,
+                daxa::TaskBufferAccess::DRAW_INDIRECT_INFO_READ,
+            },
         },
         .used_images =
         {
             { 
-                context.main_task_list.images.t_offscreen_image,
+                context.main_task_list.images.t_scene_color_image,
                 daxa::TaskImageAccess::FRAGMENT_SHADER_WRITE_ONLY,
                 daxa::ImageMipArraySlice{} 
             },
@@ -76,99 +156,158 @@ inline void task_draw_scene(RendererContext & context)
                 daxa::TaskImageAccess::FRAGMENT_SHADER_WRITE_ONLY,
                 daxa::ImageMipArraySlice{} 
             },
-            { 
-                context.main_task_list.images.t_offscreen_copy_image,
-                daxa::TaskImageAccess::FRAGMENT_SHADER_WRITE_ONLY,
-                daxa::ImageMipArraySlice{} 
-            },
             { 
                 context.main_task_list.images.t_depth_image,
                 daxa::TaskImageAccess::DEPTH_ATTACHMENT,
                 daxa::ImageMipArraySlice{.image_aspect = daxa::ImageAspectFlagBits::DEPTH} 
             }
         },
-        .task = [&](daxa::TaskRuntime const & runtime)
+        .task = [&, pass](daxa::TaskRuntime const & runtime)
         {
+            if(!is_scene_pass_active(context, pass)) { return; }
+
             auto cmd_list = runtime.get_command_list();
-            auto dimensions = context.swapchain.get_surface_extent();
+            auto dimensions = context.render_extent;
 
-            auto offscreen_image = runtime.get_images(context.main_task_list.images.t_offscreen_image);
-            auto offscreen_copy_image = runtime.get_images(context.main_task_list.images.t_offscreen_copy_image);
+            auto scene_color_image = runtime.get_images(context.main_task_list.images.t_scene_color_image);
             auto velocity_image = runtime.get_images(context.main_task_list.images.t_velocity_image);
             auto depth_image = runtime.get_images(context.main_task_list.images.t_depth_image);
 
             auto index_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_indices);
             auto vertex_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_vertices);
             auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
+            auto instance_transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_instance_transforms);
+            auto visible_instances_buffer = runtime.get_buffers(context.main_task_list.buffers.t_visible_instances);
+            auto draw_commands_buffer = runtime.get_buffers(context.main_task_list.buffers.t_draw_commands);
+            auto draw_count_buffer = runtime.get_buffers(context.main_task_list.buffers.t_draw_count);
+            auto static_visible_instances_buffer = runtime.get_buffers(context.main_task_list.buffers.t_static_visible_instances);
+            auto static_draw_commands_buffer = runtime.get_buffers(context.main_task_list.buffers.t_static_draw_commands);
+            auto fragment_count_buffer = runtime.get_buffers(context.main_task_list.buffers.t_fragment_count);
+            bool static_batching = !context.conditionals.gpu_culling && context.conditionals.static_batching;
 
-            cmd_list.reset_timestamps({ 
-                .query_pool = context.timestamps,
-                .start_index = 0,
-                .count = context.timestamps.info().query_count
-            });
+            bool depth_only = pass != ScenePass::SHADE && is_scene_pass_active(context, ScenePass::SHADE);
+            bool last_pass = pass == ScenePass::SHADE ||
+                (pass == ScenePass::LATE && !is_scene_pass_active(context, ScenePass::SHADE)) ||
+                (pass == ScenePass::EARLY && !is_scene_pass_active(context, ScenePass::LATE) && !is_scene_pass_active(context, ScenePass::SHADE));
+            auto color_load_op = pass == ScenePass::LATE ? daxa::AttachmentLoadOp::LOAD : daxa::AttachmentLoadOp::CLEAR;
+            auto depth_load_op = pass == ScenePass::EARLY ? daxa::AttachmentLoadOp::CLEAR : daxa::AttachmentLoadOp::LOAD;
 
-            cmd_list.begin_renderpass({
-                .color_attachments = 
-                { 
+            if(pass == ScenePass::EARLY)
+            {
+                cmd_list.reset_timestamps({ 
+                    .query_pool = context.timestamps,
+                    .start_index = 0,
+                    .count = context.timestamps.info().query_count
+                });
+            }
+
+            std::vector<daxa::RenderAttachmentInfo> color_attachments;
+            if(!depth_only)
+            {
+                color_attachments = {
                     {
-                        .image_view = offscreen_image[0].default_view(),
-                        .load_op = daxa::AttachmentLoadOp::CLEAR,
+                        .image_view = scene_color_image[0].default_view(),
+                        .load_op = color_load_op,
                         .clear_value = std::array<f32, 4>{0.02, 0.02, 0.02, 1.0},
                     },
-                    {
+                };
+                if(!context.conditionals.depth_velocity)
+                {
+                    color_attachments.push_back({
                         .image_view = velocity_image[0].default_view(),
-                        .load_op = daxa::AttachmentLoadOp::CLEAR,
+                        .load_op = color_load_op,
                         .clear_value = std::array<f32, 4>{0.0, 0.0, 0.0, 1.0},
-                    },
-                    {
-                        .image_view = offscreen_copy_image[0].default_view(),
-                        .load_op = daxa::AttachmentLoadOp::CLEAR,
-                        .clear_value = std::array<f32, 4>{0.02, 0.02, 0.02, 1.0},
-                    }
-                },
+                    });
+                }
+            }
+            cmd_list.begin_renderpass({
+                .color_attachments = color_attachments,
                 .depth_attachment = 
                 {{
                     .image_view = depth_image[0].default_view(),
                     .layout = daxa::ImageLayout::ATTACHMENT_OPTIMAL,
-                    .load_op = daxa::AttachmentLoadOp::CLEAR,
+                    .load_op = depth_load_op,
                     .store_op = daxa::AttachmentStoreOp::STORE,
                     .clear_value = daxa::ClearValue{daxa::DepthValue{1.0f, 0}},
                 }},
                 .render_area = {.x = 0, .y = 0, .width = dimensions.x , .height = dimensions.y}
             });
 
-            cmd_list.set_pipeline(*context.pipelines.p_draw_scene);
+            if(pass == ScenePass::SHADE) { cmd_list.set_pipeline(*context.pipelines.p_shade_scene); }
+            else if(depth_only) { cmd_list.set_pipeline(*context.pipelines.p_draw_scene_depth); }
+            else { cmd_list.set_pipeline(*context.pipelines.p_draw_scene); }
 
-            cmd_list.write_timestamp({ 
-                .query_pool = context.timestamps,
-                .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
-                .query_index = 0
-            });
-            // NOTE(msakmary) I can't put const auto & object here since than the span constructor complains
-            // and I don't know how to fig this
-            for(auto & object : context.render_info.objects)
+            if(pass == ScenePass::EARLY)
+            {
+                cmd_list.write_timestamp({ 
+                    .query_pool = context.timestamps,
+                    .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
+                    .query_index = 0
+                });
+            }
+            // nothing is bound before the first scene was swapped in
+            if(!context.render_info.instances.empty())
             {
-                for(const auto & mesh : object.meshes)
+                cmd_list.push_constant(DrawScenePC{
+                    .transforms = context.device.get_device_address(transforms_buffer[0]),
+                    .vertices = context.device.get_device_address(vertex_buffer[0]),
+                    .instance_transforms = context.device.get_device_address(instance_transforms_buffer[0]),
+                    .visible_instances = context.device.get_device_address(static_batching ? static_visible_instances_buffer[0] : visible_instances_buffer[0]),
+                    .fragment_count = context.device.get_device_address(fragment_count_buffer[0]),
+                });
+                cmd_list.set_index_buffer(index_buffer[0], 0, sizeof(u32));
+                if(context.conditionals.gpu_culling)
                 {
-                    cmd_list.push_constant(DrawScenePC{
-                        .transforms = context.device.get_device_address(transforms_buffer[0]),
-                        .vertices = context.device.get_device_address(vertex_buffer[0]),
-                        .index_offset = mesh.index_offset,
-                        .m_model = daxa::math_operators::mat_from_span<daxa::f32, 4, 4>(
-                            std::span<daxa::f32, 4 * 4>{glm::value_ptr(object.model_transform), 4 * 4})
+                    // the culling passes wrote one command per visible instance, the late pass commands follow one slot per instance
+                    auto instance_count = static_cast<u32>(context.render_info.instances.size());
+                    auto draw_indirect = [&](u32 cull_pass)
+                    {
+                        cmd_list.draw_indirect_count({
+                            .draw_command_buffer = draw_commands_buffer[0],
+                            .draw_command_buffer_read_offset = cull_pass == CULL_PASS_LATE ? sizeof(SceneDrawCommands) * instance_count : 0,
+                            .draw_count_buffer = draw_count_buffer[0],
+                            .draw_count_buffer_read_offset = cull_pass == CULL_PASS_LATE ? offsetof(SceneDrawCount, late_draw_count) : offsetof(SceneDrawCount, early_draw_count),
+                            .max_draw_count = instance_count,
+                            .draw_command_stride = sizeof(SceneDrawCommands),
+                            .is_indexed = true,
+                        });
+                    };
+                    if(pass != ScenePass::LATE) { draw_indirect(CULL_PASS_EARLY); }
+                    if(pass != ScenePass::EARLY && context.conditionals.occlusion_culling) { draw_indirect(CULL_PASS_LATE); }
+                } else if(static_batching) {
+                    // the whole scene in one call, the commands were built when the scene was prepared
+                    cmd_list.draw_indirect({
+                        .draw_command_buffer = static_draw_commands_buffer[0],
+                        .draw_command_buffer_read_offset = 0,
+                        .draw_count = context.render_info.static_draw_count,
+                        .draw_command_stride = sizeof(SceneDrawCommands),
+                        .is_indexed = true,
                     });
-                    cmd_list.set_index_buffer(index_buffer[0], sizeof(u32) * (mesh.index_buffer_offset) , sizeof(u32));
-                    cmd_list.draw_indexed({ .index_count = mesh.index_count});
+                } else {
+                    // every range is drawn once per visible instance of its mesh, the vertex offset selects the mesh
+                    for(const auto & draw : context.render_info.visible_draws)
+                    {
+                        cmd_list.draw_indexed({
+                            .index_count = draw.index_count,
+                            .instance_count = draw.instance_count,
+                            .first_index = draw.first_index,
+                            .vertex_offset = static_cast<i32>(context.render_info.meshes[draw.mesh_index].index_offset),
+                            .first_instance = draw.first_instance,
+                        });
+                    }
                 }
             }
 
-            cmd_list.write_timestamp({ 
-                .query_pool = context.timestamps,
-                .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
-                .query_index = 1
-            });
+            if(last_pass)
+            {
+                cmd_list.write_timestamp({ 
+                    .query_pool = context.timestamps,
+                    .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
+                    .query_index = 1
+                });
+            }
             cmd_list.end_renderpass();
         },
-        .debug_name = "draw scene",
+        .debug_name = pass == ScenePass::EARLY ? "draw scene early" : (pass == ScenePass::LATE ? "draw scene late" : "shade scene"),
     });
 }
\ No newline at end of file
@@ -28,6 +28,26 @@ inline void task_fill_buffers(RendererContext & context)
             {
                 context.main_task_list.buffers.t_scene_lights,
                 daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_scene_instances,
+                daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_visible_instances,
+                daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_draw_count,
+                daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_fragment_count,
+                daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
+            },
+            {
+                context.main_task_list.buffers.t_taa_tile_dispatches,
+                daxa::TaskBufferAccess::HOST_TRANSFER_WRITE,
             }
         },
         .task = [&](daxa::TaskRuntime const & runtime)
@@ -38,82 +58,120 @@ inline void task_fill_buffers(RendererContext & context)
             #pragma region transforms
             if(context.conditionals.fill_transforms != 0u)
             {
-                auto transforms_staging_buffer = context.device.create_buffer({
-                    .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .size = sizeof(TransformData),
-                    .debug_name = "staging_transforms_buffer"
-                });
-
-                auto *transform_buffer_ptr = context.device.get_host_address_as<TransformData>(transforms_staging_buffer);
-                memcpy(transform_buffer_ptr, &context.buffers.transforms_buffer.cpu_buffer, sizeof(TransformData));
-
-                cmd_list.copy_buffer_to_buffer({
-                    .src_buffer = transforms_staging_buffer,
-                    .dst_buffer = context.buffers.transforms_buffer.gpu_buffer,
-                    .size = sizeof(TransformData),
-                });
-
-                cmd_list.destroy_buffer_deferred(transforms_staging_buffer);
-                context.conditionals.fill_transforms = static_cast<u32>(false);
+                auto transforms_staging = context.upload_ring.allocate(sizeof(TransformData));
+                if(transforms_staging.has_value())
+                {
+                    memcpy(transforms_staging->host_address, &context.buffers.transforms_buffer.cpu_buffer, sizeof(TransformData));
+
+                    cmd_list.copy_buffer_to_buffer({
+                        .src_buffer = transforms_staging->buffer,
+                        .src_offset = transforms_staging->offset,
+                        .dst_buffer = context.buffers.transforms_buffer.gpu_buffer,
+                        .size = sizeof(TransformData),
+                    });
+                    context.conditionals.fill_transforms = static_cast<u32>(false);
+                } else {
+                    DEBUG_OUT("[task_fill_buffers()] upload ring exhausted, transforms not updated");
+                }
             }
             #pragma endregion transforms
 
-            #pragma region scene_data
-            if(context.conditionals.fill_scene_geometry != 0u)
+            #pragma region visible_instances
+            if(context.conditionals.fill_visible_instances)
             {
-                DEBUG_OUT("uploading scene data");
-                auto vertices_staging_buffer = context.device.create_buffer({
-                    .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .size = static_cast<u32>(sizeof(SceneGeometryVertices) * context.buffers.scene_vertices.cpu_buffer.size()),
-                    .debug_name = "staging_vertices_buffer"
-                });
-
-                auto *vertices_buffer_ptr = context.device.get_host_address_as<SceneGeometryVertices>(vertices_staging_buffer);
-                memcpy(vertices_buffer_ptr, context.buffers.scene_vertices.cpu_buffer.data(), 
-                    static_cast<u32>(sizeof(SceneGeometryVertices) * context.buffers.scene_vertices.cpu_buffer.size()));
-
-                cmd_list.copy_buffer_to_buffer({
-                    .src_buffer = vertices_staging_buffer,
-                    .dst_buffer = context.buffers.scene_vertices.gpu_buffer,
-                    .size = static_cast<u32>(sizeof(SceneGeometryVertices) * context.buffers.scene_vertices.cpu_buffer.size()),
-                });
-
-                auto indices_staging_buffer = context.device.create_buffer({
-                    .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .size = static_cast<u32>(sizeof(SceneGeometryIndices) * context.buffers.scene_indices.cpu_buffer.size()),
-                    .debug_name = "staging_indices_buffer"
-                });
-
-                auto *indices_buffer_ptr = context.device.get_host_address_as<SceneGeometryIndices>(indices_staging_buffer);
-                memcpy(indices_buffer_ptr, context.buffers.scene_indices.cpu_buffer.data(), 
-                    static_cast<u32>(sizeof(SceneGeometryIndices) * context.buffers.scene_indices.cpu_buffer.size()));
+                auto visible_instances_size = static_cast<u32>(sizeof(SceneVisibleInstances) * context.buffers.visible_instances.size());
+                auto visible_instances_staging = context.upload_ring.allocate(visible_instances_size);
+                if(visible_instances_staging.has_value())
+                {
+                    memcpy(visible_instances_staging->host_address, context.buffers.visible_instances.data(), visible_instances_size);
+
+                    cmd_list.copy_buffer_to_buffer({
+                        .src_buffer = visible_instances_staging->buffer,
+                        .src_offset = visible_instances_staging->offset,
+                        .dst_buffer = context.scene_buffers.visible_instances,
+                        .size = visible_instances_size,
+                    });
+                    context.conditionals.fill_visible_instances = false;
+                } else {
+                    DEBUG_OUT("[task_fill_buffers()] upload ring exhausted, visible instances not updated");
+                }
+            }
+            #pragma endregion visible_instances
 
-                cmd_list.copy_buffer_to_buffer({
-                    .src_buffer = indices_staging_buffer,
-                    .dst_buffer = context.buffers.scene_indices.gpu_buffer,
-                    .size = static_cast<u32>(sizeof(SceneGeometryIndices) * context.buffers.scene_indices.cpu_buffer.size()),
-                });
+            #pragma region draw_count
+            // the GPU culling pass appends to the draw count
+            if(context.conditionals.gpu_culling && context.device.is_id_valid(context.scene_buffers.draw_count))
+            {
+                auto draw_count_staging = context.upload_ring.allocate(sizeof(SceneDrawCount));
+                if(draw_count_staging.has_value())
+                {
+                    memset(draw_count_staging->host_address, 0, sizeof(SceneDrawCount));
+                    cmd_list.copy_buffer_to_buffer({
+                        .src_buffer = draw_count_staging->buffer,
+                        .src_offset = draw_count_staging->offset,
+                        .dst_buffer = context.scene_buffers.draw_count,
+                        .size = sizeof(SceneDrawCount),
+                    });
+                } else {
+                    DEBUG_OUT("[task_fill_buffers()] upload ring exhausted, draw count not reset");
+                }
+            }
+            #pragma endregion draw_count
 
-                auto lights_staging_buffer = context.device.create_buffer({
-                    .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .size = static_cast<u32>(sizeof(SceneLights) * context.buffers.scene_lights.cpu_buffer.size()),
-                    .debug_name = "staging_lights_buffer"
-                });
+            #pragma region fragment_count
+            if(context.conditionals.count_overdraw)
+            {
+                auto fragment_count_staging = context.upload_ring.allocate(sizeof(SceneFragmentCount));
+                if(fragment_count_staging.has_value())
+                {
+                    memset(fragment_count_staging->host_address, 0, sizeof(SceneFragmentCount));
+                    cmd_list.copy_buffer_to_buffer({
+                        .src_buffer = fragment_count_staging->buffer,
+                        .src_offset = fragment_count_staging->offset,
+                        .dst_buffer = context.buffers.fragment_count,
+                        .size = sizeof(SceneFragmentCount),
+                    });
+                } else {
+                    DEBUG_OUT("[task_fill_buffers()] upload ring exhausted, fragment count not reset");
+                }
+            }
+            #pragma endregion fragment_count
 
-                auto *lights_buffer_ptr = context.device.get_host_address_as<SceneLights>(lights_staging_buffer);
-                memcpy(lights_buffer_ptr, context.buffers.scene_lights.cpu_buffer.data(), 
-                    static_cast<u32>(sizeof(SceneLights) * context.buffers.scene_lights.cpu_buffer.size()));
+            #pragma region taa_tile_dispatches
+            // the classification appends the tiles of every class to its dispatch
+            context.conditionals.taa_tile_dispatches_reset = false;
+            if(context.conditionals.taa_tile_classification)
+            {
+                auto dispatches_staging = context.upload_ring.allocate(sizeof(TAATileDispatch) * TAA_TILE_CLASS_COUNT);
+                if(dispatches_staging.has_value())
+                {
+                    auto * dispatches = reinterpret_cast<TAATileDispatch *>(dispatches_staging->host_address);
+                    for(u32 tile_class = 0; tile_class < TAA_TILE_CLASS_COUNT; tile_class++)
+                    {
+                        dispatches[tile_class] = {.x = 0, .y = 0, .z = 1, .count = 0};
+                    }
+                    cmd_list.copy_buffer_to_buffer({
+                        .src_buffer = dispatches_staging->buffer,
+                        .src_offset = dispatches_staging->offset,
+                        .dst_buffer = context.buffers.taa_tile_dispatches,
+                        .size = sizeof(TAATileDispatch) * TAA_TILE_CLASS_COUNT,
+                    });
+                    context.conditionals.taa_tile_dispatches_reset = true;
+                } else {
+                    DEBUG_OUT("[task_fill_buffers()] upload ring exhausted, taa tile dispatches not reset");
+                }
+            }
+            #pragma endregion taa_tile_dispatches
 
-                cmd_list.copy_buffer_to_buffer({
-                    .src_buffer = lights_staging_buffer,
-                    .dst_buffer = context.buffers.scene_lights.gpu_buffer,
-                    .size = static_cast<u32>(sizeof(SceneLights) * context.buffers.scene_lights.cpu_buffer.size()),
+            #pragma region scene_data
+            // the pending scene buffers are not known to the task list yet, the barrier makes the streamed
+            // chunks visible to the frame in which the scene gets swapped in
+            if(context.upload_ring.record_deferred_uploads(cmd_list))
+            {
+                cmd_list.pipeline_barrier({
+                    .awaited_pipeline_access = daxa::AccessConsts::TRANSFER_WRITE,
+                    .waiting_pipeline_access = daxa::AccessConsts::READ,
                 });
-
-                cmd_list.destroy_buffer_deferred(vertices_staging_buffer);
-                cmd_list.destroy_buffer_deferred(indices_staging_buffer);
-                cmd_list.destroy_buffer_deferred(lights_staging_buffer);
-                context.conditionals.fill_scene_geometry = false;
             }
             #pragma endregion scene_data
         },
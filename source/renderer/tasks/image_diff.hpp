@@ -0,0 +1,39 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
+#include "../shared/shared.inl"
+
+inline auto get_image_diff_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo
+{
+    return {
+        .shader_info = {
+            .source = daxa::ShaderFile{"image_diff.glsl"},
+        },
+        .push_constant_size = sizeof(ImageDiffPC),
+        .debug_name = "image diff pipeline"
+    };
+}
+
+// Accumulates the per pixel difference of two images in GENERAL layout into element diff_index of diff_buffer,
+// which has to be zeroed beforehand. Waits for all compute writes recorded before it.
+inline void record_image_diff(daxa::CommandList & cmd_list, RendererContext & context, daxa::ImageId image, daxa::ImageId reference_image, daxa::BufferId diff_buffer, u32 diff_index)
+{
+    auto size = context.device.info_image(image).size;
+    cmd_list.pipeline_barrier({
+        .awaited_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_WRITE,
+        .waiting_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_READ,
+    });
+    cmd_list.set_pipeline(*context.pipelines.p_image_diff);
+    cmd_list.push_constant(ImageDiffPC{
+        .image = image.default_view(),
+        .reference_image = reference_image.default_view(),
+        .diff = context.device.get_device_address(diff_buffer) + sizeof(TAAPrecisionDiff) * diff_index,
+        .size = {size.x, size.y},
+    });
+    cmd_list.dispatch(
+        (size.x + IMAGE_DIFF_WORKGROUP_SIZE - 1) / IMAGE_DIFF_WORKGROUP_SIZE,
+        (size.y + IMAGE_DIFF_WORKGROUP_SIZE - 1) / IMAGE_DIFF_WORKGROUP_SIZE);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <initializer_list>
+
+#include <daxa/daxa.hpp>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
+#include "../shared/shared.inl"
+
+inline auto get_resample_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo
+{
+    return {
+        .shader_info = {
+            .source = daxa::ShaderFile{"resample.glsl"},
+        },
+        .push_constant_size = sizeof(ResamplePC),
+        .debug_name = "resample pipeline"
+    };
+}
+
+struct ResampleImages
+{
+    daxa::ImageId src;
+    daxa::ImageId dst;
+    // layout the previous frame left the source in
+    daxa::ImageLayout src_layout;
+};
+
+// Runs outside of the main task list between two frames, when the history images get recreated at a new size.
+// The sources are transitioned from the layout the previous frame left them in, they are destroyed afterwards.
+// The destinations are left in the same layout which the main task list assumes for them at the start of a frame.
+inline void resample_history(RendererContext & context, std::initializer_list<ResampleImages> images)
+{
+    auto cmd_list = context.device.create_command_list({.debug_name = "resample history"});
+    for(const auto & [src, dst, src_layout] : images)
+    {
+        // the previous frames may still be writing the sources
+        cmd_list.pipeline_barrier_image_transition({
+            .awaited_pipeline_access = daxa::AccessConsts::READ_WRITE,
+            .waiting_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_READ,
+            .before_layout = src_layout,
+            .after_layout = daxa::ImageLayout::READ_ONLY_OPTIMAL,
+            .image_slice = {.image_aspect = daxa::ImageAspectFlagBits::COLOR},
+            .image_id = src
+        });
+        cmd_list.pipeline_barrier_image_transition({
+            .awaited_pipeline_access = daxa::AccessConsts::BOTTOM_OF_PIPE_READ_WRITE,
+            .waiting_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_WRITE,
+            .before_layout = daxa::ImageLayout::UNDEFINED,
+            .after_layout = daxa::ImageLayout::GENERAL,
+            .image_slice = {.image_aspect = daxa::ImageAspectFlagBits::COLOR},
+            .image_id = dst
+        });
+    }
+    cmd_list.set_pipeline(*context.pipelines.p_resample);
+    for(const auto & [src, dst, src_layout] : images)
+    {
+        auto dst_size = context.device.info_image(dst).size;
+        cmd_list.push_constant(ResamplePC{
+            .src_image = src.default_view(),
+            .dst_image = dst.default_view(),
+            .linear_sampler = context.linear_sampler,
+            .dst_size = {dst_size.x, dst_size.y},
+        });
+        cmd_list.dispatch(
+            (dst_size.x + RESAMPLE_WORKGROUP_SIZE - 1) / RESAMPLE_WORKGROUP_SIZE,
+            (dst_size.y + RESAMPLE_WORKGROUP_SIZE - 1) / RESAMPLE_WORKGROUP_SIZE);
+    }
+
+    for(const auto & [src, dst, src_layout] : images)
+    {
+        cmd_list.pipeline_barrier_image_transition({
+            .awaited_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_WRITE,
+            .waiting_pipeline_access = daxa::AccessConsts::TOP_OF_PIPE_READ_WRITE,
+            .before_layout = daxa::ImageLayout::GENERAL,
+            .after_layout = daxa::ImageLayout::READ_ONLY_OPTIMAL,
+            .image_slice = {.image_aspect = daxa::ImageAspectFlagBits::COLOR},
+            .image_id = dst
+        });
+    }
+    cmd_list.complete();
+    context.device.submit_commands({.command_lists = {cmd_list}});
+}
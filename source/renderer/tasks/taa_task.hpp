@@ -4,16 +4,71 @@
 #include <daxa/utils/task_list.hpp>
 #include <daxa/utils/math_operators.hpp>
 
+#include <string>
+#include <vector>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
 #include "../shared/shared.inl"
+#include "image_diff.hpp"
+
+enum struct TAAKernel
+{
+    // every pixel with all enabled features, one group per tile of the screen
+    FULL,
+    // sorts the tiles into the lists of the kernels below
+    CLASSIFY,
+    STATIC_TILES,
+    MOVING_TILES,
+    DISOCCLUDED_TILES,
+    // FULL in single precision writing only the reference image, see compare_taa_precision
+    FP32_REFERENCE,
+};
 
-inline auto get_taa_pass_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo 
+inline auto get_taa_pass_pipeline(const RendererContext & context, TAAKernel kernel = TAAKernel::FULL) -> daxa::ComputePipelineCompileInfo 
 {
     daxa::ShaderCompileOptions compile_options;
+    compile_options.defines.push_back({"TAA_TILE_SIZE", std::to_string(context.conditionals.taa_tile_size)});
+    if(context.conditionals.depth_velocity) { compile_options.defines.push_back({"DEPTH_VELOCITY", ""}); }
+    if(kernel == TAAKernel::CLASSIFY)
+    {
+        compile_options.defines.push_back({"TAA_CLASSIFY", ""});
+        return {
+            .shader_info = { 
+                .source = daxa::ShaderFile{"taa.glsl"},
+                .compile_options = compile_options
+            },
+            .push_constant_size = sizeof(TAAPC),
+            .debug_name = "taa classify pipeline"
+        };
+    }
+
+    // the history of a converged static tile is already correct at the same pixel
+    bool neighborhood = kernel != TAAKernel::STATIC_TILES;
+    // the previous velocity only differs from the current one where the motion changes within a tile
+    bool rejection = kernel == TAAKernel::FULL || kernel == TAAKernel::DISOCCLUDED_TILES;
+    // static tiles clamp to their direct neighbors only, shading can still change under a still camera
     if(context.conditionals.color_clamp) { compile_options.defines.push_back({"COLOR_CLAMP", ""}); }
-    if(context.conditionals.velocity_rejection) { compile_options.defines.push_back({"REJECT_VELOCITY", ""}); }
-    if(context.conditionals.velocity_reproject) { compile_options.defines.push_back({"REPROJECT_VELOCITY", ""}); }
-    if(context.conditionals.nearest_depth) { compile_options.defines.push_back({"NEAREST_DEPTH", ""}); }
+    // the rejection compares against the velocity of the previous frame which is not kept when it comes from depth
+    if(context.conditionals.velocity_rejection && !context.conditionals.depth_velocity && rejection) { compile_options.defines.push_back({"REJECT_VELOCITY", ""}); }
+    if(context.conditionals.velocity_reproject && neighborhood) { compile_options.defines.push_back({"REPROJECT_VELOCITY", ""}); }
+    if(context.conditionals.nearest_depth && neighborhood) { compile_options.defines.push_back({"NEAREST_DEPTH", ""}); }
+    if(context.conditionals.taa_footprint_plus) { compile_options.defines.push_back({"TAA_FOOTPRINT_PLUS", ""}); }
+    if(context.conditionals.taa_footprint_separable) { compile_options.defines.push_back({"TAA_FOOTPRINT_SEPARABLE", ""}); }
     if(context.conditionals.accumulate) { compile_options.defines.push_back({"ACCUMULATE", ""}); }
+    if(context.render_scale < 1.0f) { compile_options.defines.push_back({"TAA_UPSAMPLE", ""}); }
+    if(context.storage_swapchain && kernel != TAAKernel::FP32_REFERENCE) { compile_options.defines.push_back({"TAA_OUTPUT_SWAPCHAIN", ""}); }
+    if(context.conditionals.taa_fp16 && context.taa_fp16_supported && kernel != TAAKernel::FP32_REFERENCE)
+    {
+        compile_options.defines.push_back({"TAA_FP16", ""});
+    }
+    switch(kernel)
+    {
+        case TAAKernel::STATIC_TILES: { compile_options.defines.push_back({"TAA_TILE_CLASS", "TAA_TILE_CLASS_STATIC"}); break; }
+        case TAAKernel::MOVING_TILES: { compile_options.defines.push_back({"TAA_TILE_CLASS", "TAA_TILE_CLASS_MOVING"}); break; }
+        case TAAKernel::DISOCCLUDED_TILES: { compile_options.defines.push_back({"TAA_TILE_CLASS", "TAA_TILE_CLASS_DISOCCLUDED"}); break; }
+        default: { break; }
+    }
     return {
         .shader_info = { 
             .source = daxa::ShaderFile{"taa.glsl"},
@@ -24,7 +79,33 @@ inline auto get_taa_pass_pipeline(const RendererContext & context) -> daxa::Comp
     };
 }
 
-inline void task_taa_pass(RendererContext & context)
+// the precision comparison resolves the full kernel in both precisions, so that only the precision differs
+inline auto taa_tiles_classified(const RendererContext & context) -> bool
+{
+    return context.conditionals.taa_tile_classification && !context.conditionals.compare_taa_precision;
+}
+
+// the classification is skipped when any of its kernels failed to compile
+inline auto taa_tile_pipelines_valid(const RendererContext & context) -> bool
+{
+    if(context.pipelines.p_taa_classify == nullptr) { return false; }
+    for(const auto & pipeline : context.pipelines.p_taa_tiles)
+    {
+        if(pipeline == nullptr) { return false; }
+    }
+    return true;
+}
+
+inline auto get_taa_tile_count(const RendererContext & context) -> u32vec2
+{
+    auto dimensions = context.swapchain.get_surface_extent();
+    u32 tile_size = context.conditionals.taa_tile_size;
+    return {(dimensions.x + tile_size - 1) / tile_size, (dimensions.y + tile_size - 1) / tile_size};
+}
+
+// Classifies every tile by the motion under it and appends it to the list and the indirect dispatch of its
+// class, the dispatches were reset to zero groups by task_fill_buffers
+inline void task_classify_taa_tiles(RendererContext & context)
 {
     context.main_task_list.task_list.add_task({
         .used_buffers =
@@ -33,24 +114,21 @@ inline void task_taa_pass(RendererContext & context)
                 context.main_task_list.buffers.t_transform_data,
                 daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
             },
-        },
-        .used_images = 
-        {
             {
-                context.main_task_list.images.t_accumulation_image,
-                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
-                daxa::ImageMipArraySlice{}
+                context.main_task_list.buffers.t_taa_tile_dispatches,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE,
             },
             {
-                context.main_task_list.images.t_offscreen_image,
-                daxa::TaskImageAccess::COMPUTE_SHADER_READ_WRITE,
-                daxa::ImageMipArraySlice{}
+                context.main_task_list.buffers.t_taa_tiles,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE_ONLY,
             },
             {
-                context.main_task_list.images.t_offscreen_copy_image,
-                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
-                daxa::ImageMipArraySlice{}
+                context.main_task_list.buffers.t_taa_tile_states,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE,
             },
+        },
+        .used_images = 
+        {
             {
                 context.main_task_list.images.t_depth_image,
                 daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
@@ -61,12 +139,121 @@ inline void task_taa_pass(RendererContext & context)
                 daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
                 daxa::ImageMipArraySlice{}
             },
+        },
+        .task = [&](daxa::TaskRuntime const & runtime)
+        {
+            if(!taa_tiles_classified(context) || !context.conditionals.taa_tile_dispatches_reset || !taa_tile_pipelines_valid(context)) { return; }
+
+            auto cmd_list = runtime.get_command_list();
+            auto dimensions = context.swapchain.get_surface_extent();
+            auto tile_count = get_taa_tile_count(context);
+
+            auto depth_image = runtime.get_images(context.main_task_list.images.t_depth_image);
+            auto velocity_image = runtime.get_images(context.main_task_list.images.t_velocity_image);
+            auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
+            auto tile_dispatches_buffer = runtime.get_buffers(context.main_task_list.buffers.t_taa_tile_dispatches);
+            auto tiles_buffer = runtime.get_buffers(context.main_task_list.buffers.t_taa_tiles);
+            auto tile_states_buffer = runtime.get_buffers(context.main_task_list.buffers.t_taa_tile_states);
+
+            cmd_list.write_timestamp({ 
+                .query_pool = context.timestamps,
+                .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
+                .query_index = 2
+            });
+            cmd_list.set_pipeline(*context.pipelines.p_taa_classify);
+            cmd_list.push_constant(TAAPC{
+                .transforms = context.device.get_device_address(transforms_buffer[0]),
+                .depth_image          = depth_image[0].default_view(),
+                .velocity_image       = velocity_image[0].default_view(),
+                .nearest_sampler      = context.nearest_sampler,
+                .swapchain_dimensions = {dimensions.x, dimensions.y},
+                .render_dimensions = {context.render_extent.x, context.render_extent.y},
+                .first_frame = context.conditionals.clear_accumulation ? 1u : 0u,
+                .tile_dispatches = context.device.get_device_address(tile_dispatches_buffer[0]),
+                .tiles = context.device.get_device_address(tiles_buffer[0]),
+                .tile_states = context.device.get_device_address(tile_states_buffer[0]),
+                .tile_count = {tile_count.x, tile_count.y},
+                .tile_capacity = context.taa_tile_capacity,
+                .reset_tiles = context.conditionals.reset_taa_tiles ? 1u : 0u,
+            });
+            cmd_list.dispatch(tile_count.x, tile_count.y);
+            context.conditionals.reset_taa_tiles = false;
+        },
+        .debug_name = "classify taa tiles"
+    });
+}
+
+// Resolves the scene color against the history in accumulation_image into offscreen_image, which becomes
+// the history of the next frame once the two are swapped. With a storage swapchain the tonemapped result
+// is written into the swapchain by the same dispatch and the tonemap pass is left out of the task list.
+// With tile classification every class runs its own kernel over the tiles listed for it. While the precisions
+// are compared the single precision kernel additionally resolves into the reference image, outside of the timing.
+inline void task_taa_pass(RendererContext & context)
+{
+    std::vector<daxa::TaskImageUse> used_images = 
+    {
+        {
+            context.main_task_list.images.t_accumulation_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+            daxa::ImageMipArraySlice{}
+        },
+        {
+            context.main_task_list.images.t_offscreen_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_WRITE_ONLY,
+            daxa::ImageMipArraySlice{}
+        },
+        {
+            context.main_task_list.images.t_scene_color_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+            daxa::ImageMipArraySlice{}
+        },
+        {
+            context.main_task_list.images.t_depth_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+            daxa::ImageMipArraySlice{.image_aspect = daxa::ImageAspectFlagBits::DEPTH}
+        },
+        {
+            context.main_task_list.images.t_velocity_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+            daxa::ImageMipArraySlice{}
+        },
+        {
+            context.main_task_list.images.t_prev_velocity_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+            daxa::ImageMipArraySlice{}
+        },
+        {
+            context.main_task_list.images.t_taa_reference_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_READ_WRITE,
+            daxa::ImageMipArraySlice{}
+        },
+    };
+    if(context.storage_swapchain)
+    {
+        used_images.push_back({
+            context.main_task_list.images.t_swapchain_image,
+            daxa::TaskImageAccess::COMPUTE_SHADER_WRITE_ONLY,
+            daxa::ImageMipArraySlice{}
+        });
+    }
+
+    context.main_task_list.task_list.add_task({
+        .used_buffers =
+        {
             {
-                context.main_task_list.images.t_prev_velocity_image,
-                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
-                daxa::ImageMipArraySlice{}
+                context.main_task_list.buffers.t_transform_data,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_taa_tile_dispatches,
+                daxa::TaskBufferAccess::DRAW_INDIRECT_INFO_READ,
+            },
+            {
+                context.main_task_list.buffers.t_taa_tiles,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
             },
         },
+        .used_images = used_images,
         .task = [&](daxa::TaskRuntime const & runtime)
         {
             auto cmd_list = runtime.get_command_list();
@@ -74,38 +261,102 @@ inline void task_taa_pass(RendererContext & context)
 
             auto accumulation_image = runtime.get_images(context.main_task_list.images.t_accumulation_image);
             auto offscreen_image = runtime.get_images(context.main_task_list.images.t_offscreen_image);
-            auto offscreen_copy_image = runtime.get_images(context.main_task_list.images.t_offscreen_copy_image);
+            auto scene_color_image = runtime.get_images(context.main_task_list.images.t_scene_color_image);
             auto depth_image = runtime.get_images(context.main_task_list.images.t_depth_image);
             auto velocity_image = runtime.get_images(context.main_task_list.images.t_velocity_image);
             auto prev_velocity_image = runtime.get_images(context.main_task_list.images.t_prev_velocity_image);
             auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
+            auto tile_dispatches_buffer = runtime.get_buffers(context.main_task_list.buffers.t_taa_tile_dispatches);
+            auto tiles_buffer = runtime.get_buffers(context.main_task_list.buffers.t_taa_tiles);
+            auto tile_count = get_taa_tile_count(context);
+            bool classified = taa_tiles_classified(context) && context.conditionals.taa_tile_dispatches_reset && taa_tile_pipelines_valid(context);
+            if(!classified && context.pipelines.p_taa_pass == nullptr) { return; }
+            daxa::ImageViewId swapchain_view = {};
+            if(context.storage_swapchain)
+            {
+                swapchain_view = runtime.get_images(context.main_task_list.images.t_swapchain_image)[0].default_view();
+            }
 
-            cmd_list.set_pipeline(*context.pipelines.p_taa_pass);
-            cmd_list.push_constant(TAAPC{
+            auto push_constant = TAAPC{
                 .transforms = context.device.get_device_address(transforms_buffer[0]),
                 .depth_image          = depth_image[0].default_view(),
                 .offscreen_image      = offscreen_image[0].default_view(),
-                .offscreen_copy_image = offscreen_copy_image[0].default_view(),
+                .scene_color_image    = scene_color_image[0].default_view(),
+                .swapchain_image      = swapchain_view,
                 .velocity_image       = velocity_image[0].default_view(),
                 .prev_velocity_image  = prev_velocity_image[0].default_view(),
                 .accumulation_image   = accumulation_image[0].default_view(),
                 .nearest_sampler      = context.nearest_sampler,
                 .swapchain_dimensions = {dimensions.x, dimensions.y},
-                .first_frame = context.conditionals.clear_accumulation ? 1u : 0u
-            });
-            cmd_list.write_timestamp({ 
-                .query_pool = context.timestamps,
-                .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
-                .query_index = 2
-            });
-            cmd_list.dispatch(((dimensions.x + 7) / 8), ((dimensions.y + 3) / 4));
+                .render_dimensions = {context.render_extent.x, context.render_extent.y},
+                .first_frame = context.conditionals.clear_accumulation ? 1u : 0u,
+                .tile_dispatches = context.device.get_device_address(tile_dispatches_buffer[0]),
+                .tiles = context.device.get_device_address(tiles_buffer[0]),
+                .tile_count = {tile_count.x, tile_count.y},
+                .tile_capacity = context.taa_tile_capacity,
+            };
+            if(!classified)
+            {
+                cmd_list.write_timestamp({ 
+                    .query_pool = context.timestamps,
+                    .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
+                    .query_index = 2
+                });
+                cmd_list.set_pipeline(*context.pipelines.p_taa_pass);
+                cmd_list.push_constant(push_constant);
+                cmd_list.dispatch(tile_count.x, tile_count.y);
+            } else {
+                // the task list only orders the classification before the indirect read of the dispatches,
+                // the kernels also read the tile counts from them
+                cmd_list.pipeline_barrier({
+                    .awaited_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_WRITE,
+                    .waiting_pipeline_access = daxa::AccessConsts::COMPUTE_SHADER_READ,
+                });
+                for(u32 tile_class = 0; tile_class < TAA_TILE_CLASS_COUNT; tile_class++)
+                {
+                    cmd_list.set_pipeline(*context.pipelines.p_taa_tiles[tile_class]);
+                    cmd_list.push_constant(push_constant);
+                    cmd_list.dispatch_indirect({
+                        .indirect_buffer = tile_dispatches_buffer[0],
+                        .offset = sizeof(TAATileDispatch) * tile_class,
+                    });
+                }
+            }
             cmd_list.write_timestamp({ 
                 .query_pool = context.timestamps,
                 .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE,
                 .query_index = 3
             });
+            if(context.conditionals.compare_taa_precision && context.pipelines.p_taa_reference != nullptr)
+            {
+                auto reference_image = runtime.get_images(context.main_task_list.images.t_taa_reference_image);
+                push_constant.offscreen_image = reference_image[0].default_view();
+                cmd_list.set_pipeline(*context.pipelines.p_taa_reference);
+                cmd_list.push_constant(push_constant);
+                cmd_list.dispatch(tile_count.x, tile_count.y);
+                record_image_diff(cmd_list, context, offscreen_image[0], reference_image[0], context.buffers.taa_precision_diff_readback, context.upload_ring.segment_index);
+            }
             if(context.conditionals.clear_accumulation == true) { context.conditionals.clear_accumulation = false; }
         },
         .debug_name = "task taa pass"
     });
+}
+
+// Without the tonemap pass nothing reads the resolved history after it was written. The next frame starts with it
+// as the accumulation image in READ_ONLY_OPTIMAL, this task makes the task list transition it there.
+inline void task_finish_taa_history(RendererContext & context)
+{
+    context.main_task_list.task_list.add_task({
+        .used_buffers = {},
+        .used_images = 
+        {
+            {
+                context.main_task_list.images.t_offscreen_image,
+                daxa::TaskImageAccess::COMPUTE_SHADER_READ_ONLY,
+                daxa::ImageMipArraySlice{}
+            },
+        },
+        .task = [](daxa::TaskRuntime const &) {},
+        .debug_name = "task finish taa history"
+    });
 }
\ No newline at end of file
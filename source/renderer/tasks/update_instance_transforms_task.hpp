@@ -0,0 +1,63 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/task_list.hpp>
+
+#include "../../types.hpp"
+#include "../renderer_context.hpp"
+#include "../shared/shared.inl"
+
+inline auto get_update_instance_transforms_pipeline(const RendererContext & context) -> daxa::ComputePipelineCompileInfo
+{
+    return {
+        .shader_info = {
+            .source = daxa::ShaderFile{"instance_transforms.glsl"},
+        },
+        .push_constant_size = sizeof(UpdateInstanceTransformsPC),
+        .debug_name = "update instance transforms pipeline"
+    };
+}
+
+// Premultiplies the model matrix of every instance with the current and the previous view projection so that
+// the vertex shader is left with two matrix vector products. Only runs when one of the matrices changed.
+inline void task_update_instance_transforms(RendererContext & context)
+{
+    context.main_task_list.task_list.add_task({
+        .used_buffers =
+        {
+            {
+                context.main_task_list.buffers.t_transform_data,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_scene_instances,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_READ_ONLY,
+            },
+            {
+                context.main_task_list.buffers.t_instance_transforms,
+                daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE_ONLY,
+            },
+        },
+        .task = [&](daxa::TaskRuntime const & runtime)
+        {
+            auto instance_count = static_cast<u32>(context.render_info.instances.size());
+            if(!context.conditionals.update_instance_transforms || instance_count == 0) { return; }
+
+            auto cmd_list = runtime.get_command_list();
+            auto transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_transform_data);
+            auto instances_buffer = runtime.get_buffers(context.main_task_list.buffers.t_scene_instances);
+            auto instance_transforms_buffer = runtime.get_buffers(context.main_task_list.buffers.t_instance_transforms);
+
+            cmd_list.set_pipeline(*context.pipelines.p_update_instance_transforms);
+            cmd_list.push_constant(UpdateInstanceTransformsPC{
+                .transforms = context.device.get_device_address(transforms_buffer[0]),
+                .instances = context.device.get_device_address(instances_buffer[0]),
+                .instance_transforms = context.device.get_device_address(instance_transforms_buffer[0]),
+                .instance_count = instance_count,
+            });
+            cmd_list.dispatch((instance_count + INSTANCE_TRANSFORMS_WORKGROUP_SIZE - 1) / INSTANCE_TRANSFORMS_WORKGROUP_SIZE);
+            context.conditionals.update_instance_transforms = false;
+        },
+        .debug_name = "update instance transforms",
+    });
+}
@@ -0,0 +1,86 @@
+#include "upload_ring.hpp"
+
+#include <cstring>
+
+void UploadRing::begin_frame()
+{
+    segment_index = (segment_index + 1) % SEGMENT_COUNT;
+    segment_offset = 0;
+}
+
+auto UploadRing::allocate(u32 size, u32 alignment) -> std::optional<Allocation>
+{
+    u32 offset = (segment_offset + alignment - 1) / alignment * alignment;
+    if(offset > segment_size || size > segment_size - offset) { return std::nullopt; }
+
+    segment_offset = offset + size;
+    u32 ring_offset = segment_index * segment_size + offset;
+    return Allocation{
+        .buffer = buffer,
+        .offset = ring_offset,
+        .host_address = host_address + ring_offset,
+    };
+}
+
+void UploadRing::enqueue(DeferredUpload upload)
+{
+    if(upload.size == 0) { return; }
+    deferred_uploads.push_back(std::move(upload));
+}
+
+auto UploadRing::record_deferred_uploads(daxa::CommandList & cmd_list) -> bool
+{
+    bool recorded = false;
+    u32 remaining_budget = frame_budget;
+    while(!deferred_uploads.empty() && remaining_budget > 0)
+    {
+        auto & upload = deferred_uploads.front();
+        u32 aligned_offset = (segment_offset + 15u) & ~15u;
+        u32 available = segment_size > aligned_offset ? segment_size - aligned_offset : 0u;
+        u32 chunk_size = glm::min(upload.size, glm::min(remaining_budget, available));
+        // keep chunks 4 byte aligned, copies of buffer sizes which are not a multiple of 4 only happen at the very end
+        if(chunk_size < upload.size) { chunk_size &= ~3u; }
+        if(chunk_size == 0) { break; }
+
+        auto allocation = allocate(chunk_size);
+        if(!allocation.has_value()) { break; }
+
+        memcpy(allocation->host_address, upload.data->data() + upload.src_offset, chunk_size);
+        cmd_list.copy_buffer_to_buffer({
+            .src_buffer = allocation->buffer,
+            .src_offset = allocation->offset,
+            .dst_buffer = upload.dst_buffer,
+            .dst_offset = upload.dst_offset,
+            .size = chunk_size,
+        });
+        recorded = true;
+        remaining_budget -= chunk_size;
+
+        upload.src_offset += chunk_size;
+        upload.dst_offset += chunk_size;
+        upload.size -= chunk_size;
+        if(upload.size == 0) { deferred_uploads.pop_front(); }
+    }
+    return recorded;
+}
+
+auto create_upload_ring(daxa::Device & device, const UploadRingInfo & info) -> UploadRing
+{
+    UploadRing ring = {
+        .segment_size = info.segment_size,
+        .frame_budget = info.frame_budget,
+    };
+    ring.buffer = device.create_buffer({
+        .memory_flags = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .size = info.segment_size * UploadRing::SEGMENT_COUNT,
+        .debug_name = "upload_ring"
+    });
+    ring.host_address = device.get_host_address_as<u8>(ring.buffer);
+    return ring;
+}
+
+void destroy_upload_ring(daxa::Device & device, UploadRing & ring)
+{
+    if(device.is_id_valid(ring.buffer)) { device.destroy_buffer(ring.buffer); }
+    ring = {};
+}
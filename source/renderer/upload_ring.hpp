@@ -0,0 +1,65 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <daxa/daxa.hpp>
+
+#include "../types.hpp"
+
+// Frames which may be in flight on the GPU at once, the swapchain is created with the same limit
+const u32 MAX_FRAMES_IN_FLIGHT = 2u;
+
+// Persistently mapped staging buffer split into one segment per frame which can be in flight plus the frame
+// being recorded. Allocations are bump allocated from the current segment, a segment is only written again
+// after the swapchain made sure the GPU finished the frame which used it last.
+struct UploadRing
+{
+    static constexpr u32 SEGMENT_COUNT = MAX_FRAMES_IN_FLIGHT + 1;
+
+    struct Allocation
+    {
+        daxa::BufferId buffer;
+        u32 offset;
+        u8 * host_address;
+    };
+
+    // Upload too large for a single frame, streamed in chunks from the CPU copy in data
+    struct DeferredUpload
+    {
+        std::shared_ptr<const std::vector<u8>> data;
+        u32 src_offset;
+        daxa::BufferId dst_buffer;
+        u32 dst_offset;
+        u32 size;
+    };
+
+    daxa::BufferId buffer;
+    u8 * host_address = nullptr;
+    u32 segment_size = 0;
+    // at most this many bytes of deferred uploads are recorded per frame
+    u32 frame_budget = 0;
+    u32 segment_index = 0;
+    u32 segment_offset = 0;
+    std::deque<DeferredUpload> deferred_uploads;
+
+    // switches to the segment of the next frame, has to be called after the swapchain image was acquired
+    void begin_frame();
+    // returns std::nullopt when the current segment is exhausted
+    [[nodiscard]] auto allocate(u32 size, u32 alignment = 16) -> std::optional<Allocation>;
+    void enqueue(DeferredUpload upload);
+    // records copies of as many deferred bytes as the frame budget allows, returns true when any were recorded
+    auto record_deferred_uploads(daxa::CommandList & cmd_list) -> bool;
+    [[nodiscard]] auto has_deferred_uploads() const -> bool { return !deferred_uploads.empty(); }
+};
+
+struct UploadRingInfo
+{
+    u32 segment_size;
+    u32 frame_budget;
+};
+
+[[nodiscard]] auto create_upload_ring(daxa::Device & device, const UploadRingInfo & info) -> UploadRing;
+void destroy_upload_ring(daxa::Device & device, UploadRing & ring);
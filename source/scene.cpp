@@ -1,12 +1,35 @@
 #include "scene.hpp"
+#include "scene_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+
+#include <assimp/ProgressHandler.hpp>
 
 #include <stack>
 #include <string>
 #include <unordered_map>
 
+// Fraction of the load progress covered by the Assimp import and by the mesh processing
+const f32 IMPORT_PROGRESS = 0.3f;
+const f32 PROCESS_PROGRESS = 0.5f;
+
+// Forwards the Assimp import progress, returning false from Update aborts the import
+struct ImportProgressHandler : Assimp::ProgressHandler
+{
+    SceneLoadProgress & progress;
+
+    explicit ImportProgressHandler(SceneLoadProgress & progress) : progress{progress} {}
+
+    auto Update(float percentage) -> bool override
+    {
+        if(percentage >= 0.0f) { progress.fraction = glm::clamp(percentage, 0.0f, 1.0f) * IMPORT_PROGRESS; }
+        return !progress.cancelled;
+    }
+};
+
 void Scene::process_mesh(const ProcessMeshInfo & info)
 {
-    auto & new_mesh = info.object.meshes.emplace_back(RuntimeMesh{});
+    auto & new_mesh = info.runtime_mesh;
     new_mesh.vertices.reserve(info.mesh->mNumVertices);
     new_mesh.indices.reserve(static_cast<std::vector<u32>::size_type>(info.mesh->mNumFaces) * 3); // expect triangles
     for(u32 vertex = 0; vertex < info.mesh->mNumVertices; vertex++)
@@ -29,8 +52,6 @@ void Scene::process_mesh(const ProcessMeshInfo & info)
         });
     }
 
-    f32mat4x4 m_model = info.object.transform;
-
     // NOTE(msakmary) I am assuming triangles here
     for(u32 face = 0; face < info.mesh->mNumFaces; face++)
     {
@@ -42,7 +63,7 @@ void Scene::process_mesh(const ProcessMeshInfo & info)
     }
 }
 
-void Scene::process_scene(const aiScene * scene)
+void Scene::process_scene(const aiScene * scene, JobSystem & job_system, SceneLoadProgress * progress)
 {
     auto mat_assimp_to_glm = [](const aiMatrix4x4 & mat) -> f32mat4x4
     {
@@ -64,6 +85,12 @@ void Scene::process_scene(const aiScene * scene)
     using node_element = std::tuple<const aiNode *, aiMatrix4x4>; 
     std::stack<node_element> node_stack;
 
+    // meshes referenced by several nodes are converted only once, unique_mesh_indices maps
+    // an aiMesh index to its entry in meshes which is then shared by all referencing objects
+    const u32 INVALID_MESH_INDEX = ~0u;
+    std::vector<u32> unique_mesh_indices(scene->mNumMeshes, INVALID_MESH_INDEX);
+    std::vector<const aiMesh *> mesh_tasks;
+
     node_stack.push({scene->mRootNode, aiMatrix4x4()});
 
     while(!node_stack.empty())
@@ -84,14 +111,17 @@ void Scene::process_scene(const aiScene * scene)
             auto & new_scene_object = scene_objects.emplace_back(SceneObject{
                 .transform = mat_assimp_to_glm(node_transform)
             });
+            new_scene_object.mesh_indices.reserve(node->mNumMeshes);
 
             for(u32 i = 0; i < node->mNumMeshes; i++)
             {
-                process_mesh({
-                    .mesh = scene->mMeshes[node->mMeshes[i]],
-                    .scene = scene,
-                    .object = new_scene_object
-                });
+                u32 & unique_mesh_index = unique_mesh_indices[node->mMeshes[i]];
+                if(unique_mesh_index == INVALID_MESH_INDEX)
+                {
+                    unique_mesh_index = static_cast<u32>(mesh_tasks.size());
+                    mesh_tasks.push_back(scene->mMeshes[node->mMeshes[i]]);
+                }
+                new_scene_object.mesh_indices.push_back(unique_mesh_index);
             }
         }
         node_stack.pop();
@@ -101,11 +131,67 @@ void Scene::process_scene(const aiScene * scene)
             node_stack.push({child, node_transform});
         }
     }
+
+    meshes.resize(mesh_tasks.size());
+    std::vector<MeshOptimizationStats> mesh_stats(mesh_tasks.size());
+    std::atomic<usize> processed_meshes = 0;
+    job_system.parallel_for(mesh_tasks.size(), 1, [&](usize begin, usize end)
+    {
+        for(usize task = begin; task < end; task++)
+        {
+            // remaining meshes are skipped once the load is cancelled, the scene is thrown away anyway
+            if(progress != nullptr && progress->cancelled) { return; }
+            auto & runtime_mesh = meshes[task];
+            process_mesh({
+                .mesh = mesh_tasks[task],
+                .scene = scene,
+                .runtime_mesh = runtime_mesh
+            });
+            mesh_stats[task] = optimize_mesh(runtime_mesh);
+            generate_mesh_lods(runtime_mesh);
+            if(progress != nullptr)
+            {
+                progress->fraction = IMPORT_PROGRESS + PROCESS_PROGRESS * f32(++processed_meshes) / f32(mesh_tasks.size());
+            }
+        }
+    });
+    if(progress != nullptr && progress->cancelled)
+    {
+        scene_objects.clear();
+        meshes.clear();
+        scene_lights.clear();
+        return;
+    }
+
+    MeshOptimizationStats total_stats;
+    for(const auto & stats : mesh_stats) { total_stats += stats; }
+    optimization_stats = {
+        .vertices_before = total_stats.vertices_before,
+        .vertices_after = total_stats.vertices_after,
+        .acmr_before = total_stats.get_acmr_before(),
+        .acmr_after = total_stats.get_acmr_after(),
+    };
+    DEBUG_OUT("[Scene::process_scene()] " << scene_objects.size() << " objects reference " << meshes.size() << " unique meshes");
+    DEBUG_OUT("[Scene::process_scene()] Mesh optimization vertices " << total_stats.vertices_before << " -> " << total_stats.vertices_after
+              << " ACMR " << total_stats.get_acmr_before() << " -> " << total_stats.get_acmr_after());
 };
 
-Scene::Scene(const std::string & scene_path)
+Scene::Scene(const std::string & scene_path, JobSystem & job_system, SceneLoadProgress * progress)
 {
+    u64 source_hash = hash_file_contents(scene_path);
+    std::string cache_path = get_scene_cache_path(source_hash);
+    cache = SceneCache::load(cache_path, source_hash);
+    if(cache != nullptr)
+    {
+        scene_lights.assign(cache->lights.begin(), cache->lights.end());
+        optimization_stats = cache->optimization_stats;
+        if(progress != nullptr) { progress->fraction = IMPORT_PROGRESS + PROCESS_PROGRESS; }
+        return;
+    }
+
     Assimp::Importer importer;
+    // the importer takes ownership of the handler
+    if(progress != nullptr) { importer.SetProgressHandler(new ImportProgressHandler(*progress)); }
     const aiScene * scene = importer.ReadFile( 
         scene_path,
         0u 
@@ -122,5 +208,11 @@ Scene::Scene(const std::string & scene_path)
         return;
     }
 
-    process_scene(scene);
+    process_scene(scene, job_system, progress);
+    if(progress != nullptr && progress->cancelled)
+    {
+        DEBUG_OUT("[Scene::Scene()] Load of " << scene_path << " cancelled");
+        return;
+    }
+    SceneCache::store(cache_path, source_hash, *this);
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <utility>
@@ -10,6 +12,7 @@
 
 #include "types.hpp"
 #include "utils.hpp"
+#include "job_system.hpp"
 
 struct Vertex
 {
@@ -17,17 +20,30 @@ struct Vertex
     f32vec3 normal;
 };
 
+// Full detail mesh included
+const u32 MAX_MESH_LODS = 5u;
+
+struct MeshLod
+{
+    std::vector<u32> indices;
+    // mesh space bound of how far any full detail vertex moved to reach its simplified vertex
+    f32 error;
+};
+
 struct RuntimeMesh
 {
     std::vector<u32> indices;
     std::vector<Vertex> vertices;
+    // progressively coarser levels of detail, their indices reference the same vertices
+    std::vector<MeshLod> lods;
 };
 
-// Scene object used in real time visualisation
+// Scene object used in real time visualisation, every object is an instance of the shared meshes it references
 struct SceneObject
 {
     f32mat4x4 transform;
-    std::vector<RuntimeMesh> meshes;
+    // indices into Scene::meshes
+    std::vector<u32> mesh_indices;
 };
 
 struct SceneLight
@@ -40,18 +56,43 @@ struct ProcessMeshInfo
 {
     const aiMesh * mesh;
     const aiScene * scene;
-    SceneObject & object;
+    RuntimeMesh & runtime_mesh;
+};
+
+struct SceneCache;
+
+// Shared between a scene load running on a worker thread and the thread observing it
+struct SceneLoadProgress
+{
+    // zero to one over the whole load including the renderer side preparation
+    std::atomic<f32> fraction = 0.0f;
+    std::atomic<bool> cancelled = false;
+};
+
+// Import-time statistics of the mesh optimization stage summed over all meshes
+struct SceneOptimizationStats
+{
+    u64 vertices_before = 0;
+    u64 vertices_after = 0;
+    f32 acmr_before = 0.0f;
+    f32 acmr_after = 0.0f;
 };
 
 struct Scene
 {
     std::vector<SceneObject> scene_objects;
+    // one entry per referenced aiMesh no matter how many nodes reference it
+    std::vector<RuntimeMesh> meshes;
     std::vector<SceneLight> scene_lights;
+    // Set when the scene was loaded from the binary scene cache, scene_objects and meshes stay empty in that case
+    std::shared_ptr<const SceneCache> cache;
+    SceneOptimizationStats optimization_stats;
 
-    explicit Scene(const std::string & scene_path);
+    // a cancelled load leaves the scene empty
+    Scene(const std::string & scene_path, JobSystem & job_system, SceneLoadProgress * progress = nullptr);
 
     private:
-        void process_scene(const aiScene * scene);
+        void process_scene(const aiScene * scene, JobSystem & job_system, SceneLoadProgress * progress);
         void process_mesh(const ProcessMeshInfo & info);
         void convert_to_raytrace_scene();
 };
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "scene_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string & path)
+{
+#if defined(_WIN32)
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE) { file_handle = nullptr; return; }
+
+    LARGE_INTEGER file_size;
+    if(GetFileSizeEx(file_handle, &file_size) == 0 || file_size.QuadPart == 0) { return; }
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle == nullptr) { return; }
+
+    mapped_data = static_cast<const u8 *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if(mapped_data != nullptr) { mapped_size = static_cast<usize>(file_size.QuadPart); }
+#else
+    i32 fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) { return; }
+
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) { close(fd); return; }
+
+    void * mapping = mmap(nullptr, static_cast<usize>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if(mapping == MAP_FAILED) { return; }
+
+    madvise(mapping, static_cast<usize>(file_stat.st_size), MADV_WILLNEED);
+    mapped_data = static_cast<const u8 *>(mapping);
+    mapped_size = static_cast<usize>(file_stat.st_size);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+    if(mapped_data != nullptr) { UnmapViewOfFile(mapped_data); }
+    if(mapping_handle != nullptr) { CloseHandle(mapping_handle); }
+    if(file_handle != nullptr) { CloseHandle(file_handle); }
+#else
+    if(mapped_data != nullptr) { munmap(const_cast<u8 *>(mapped_data), mapped_size); }
+#endif
+}
+
+auto hash_file_contents(const std::string & path) -> u64
+{
+    MappedFile file(path);
+    if(!file.is_valid()) { return 0ull; }
+    return hash_bytes(file.data(), file.size(), FNV_OFFSET_BASIS ^ file.size());
+}
+
+auto get_scene_cache_path(u64 source_hash) -> std::string
+{
+    char hash_string[17];
+    snprintf(hash_string, sizeof(hash_string), "%016llx", static_cast<unsigned long long>(source_hash));
+    return std::string("scene_cache/") + hash_string + ".bin";
+}
+
+SceneCache::SceneCache(const std::string & cache_path) : file{cache_path}, header{}
+{
+}
+
+auto SceneCache::load(const std::string & cache_path, u64 source_hash) -> std::shared_ptr<const SceneCache>
+{
+    auto cache = std::make_shared<SceneCache>(cache_path);
+    if(!cache->file.is_valid() || cache->file.size() < sizeof(SceneCacheHeader)) { return nullptr; }
+
+    memcpy(&cache->header, cache->file.data(), sizeof(SceneCacheHeader));
+    const auto & header = cache->header;
+    if(header.magic != SCENE_CACHE_MAGIC || header.version != SCENE_CACHE_VERSION || header.source_hash != source_hash)
+    {
+        DEBUG_OUT("[SceneCache::load()] Stale scene cache " << cache_path);
+        return nullptr;
+    }
+
+    auto section_fits = [&](const SceneCacheSection & section, usize element_size) -> bool
+    {
+        return section.offset <= cache->file.size() &&
+               section.count <= (cache->file.size() - section.offset) / element_size;
+    };
+
+    if(!section_fits(header.objects, sizeof(CachedObject)) ||
+       !section_fits(header.object_meshes, sizeof(u32))    ||
+       !section_fits(header.meshes, sizeof(CachedMesh))    ||
+       !section_fits(header.vertices, sizeof(Vertex))      ||
+       !section_fits(header.indices, sizeof(u32))          ||
+       !section_fits(header.lights, sizeof(SceneLight)))
+    {
+        DEBUG_OUT("[SceneCache::load()] Truncated scene cache " << cache_path);
+        return nullptr;
+    }
+
+    auto get_section = [&]<typename T>(const SceneCacheSection & section) -> std::span<const T>
+    {
+        return {reinterpret_cast<const T *>(cache->file.data() + section.offset), static_cast<usize>(section.count)};
+    };
+
+    cache->objects = get_section.template operator()<CachedObject>(header.objects);
+    cache->object_meshes = get_section.template operator()<u32>(header.object_meshes);
+    cache->meshes = get_section.template operator()<CachedMesh>(header.meshes);
+    cache->vertices = get_section.template operator()<Vertex>(header.vertices);
+    cache->indices = get_section.template operator()<u32>(header.indices);
+    cache->lights = get_section.template operator()<SceneLight>(header.lights);
+    cache->optimization_stats = header.optimization_stats;
+    // ranges are validated once here so that consumers can index into the spans freely
+    for(const auto & object : cache->objects)
+    {
+        if(static_cast<u64>(object.first_mesh) + object.mesh_count > cache->object_meshes.size()) { return nullptr; }
+    }
+    for(u32 mesh_index : cache->object_meshes)
+    {
+        if(mesh_index >= cache->meshes.size()) { return nullptr; }
+    }
+    for(const auto & mesh : cache->meshes)
+    {
+        if(mesh.lod_count == 0 || mesh.lod_count > MAX_MESH_LODS) { return nullptr; }
+        u64 mesh_index_count = 0;
+        for(u32 lod = 0; lod < mesh.lod_count; lod++) { mesh_index_count += mesh.lod_index_counts[lod]; }
+        if(static_cast<u64>(mesh.first_vertex) + mesh.vertex_count > cache->vertices.size() ||
+           static_cast<u64>(mesh.first_index) + mesh_index_count > cache->indices.size())
+        {
+            DEBUG_OUT("[SceneCache::load()] Corrupt mesh ranges in scene cache " << cache_path);
+            return nullptr;
+        }
+    }
+    DEBUG_OUT("[SceneCache::load()] Loaded scene cache " << cache_path);
+    return cache;
+}
+
+void SceneCache::store(const std::string & cache_path, u64 source_hash, const Scene & scene)
+{
+    std::vector<CachedObject> objects;
+    std::vector<u32> object_meshes;
+    std::vector<CachedMesh> meshes;
+    objects.reserve(scene.scene_objects.size());
+    meshes.reserve(scene.meshes.size());
+
+    for(const auto & scene_object : scene.scene_objects)
+    {
+        objects.push_back({
+            .transform = scene_object.transform,
+            .first_mesh = static_cast<u32>(object_meshes.size()),
+            .mesh_count = static_cast<u32>(scene_object.mesh_indices.size())
+        });
+        object_meshes.insert(object_meshes.end(), scene_object.mesh_indices.begin(), scene_object.mesh_indices.end());
+    }
+
+    u64 vertex_count = 0;
+    u64 index_count = 0;
+    for(const auto & mesh : scene.meshes)
+    {
+        auto & cached_mesh = meshes.emplace_back(CachedMesh{
+            .first_vertex = static_cast<u32>(vertex_count),
+            .vertex_count = static_cast<u32>(mesh.vertices.size()),
+            .first_index = static_cast<u32>(index_count),
+            .lod_count = static_cast<u32>(mesh.lods.size() + 1),
+            .lod_index_counts = {static_cast<u32>(mesh.indices.size())},
+            .lod_errors = {0.0f},
+        });
+        for(usize lod = 0; lod < mesh.lods.size(); lod++)
+        {
+            cached_mesh.lod_index_counts[lod + 1] = static_cast<u32>(mesh.lods[lod].indices.size());
+            cached_mesh.lod_errors[lod + 1] = mesh.lods[lod].error;
+        }
+        vertex_count += mesh.vertices.size();
+        for(u32 lod = 0; lod < cached_mesh.lod_count; lod++) { index_count += cached_mesh.lod_index_counts[lod]; }
+    }
+
+    // keep every section 16 byte aligned so the mapped spans are always properly aligned
+    auto align_up = [](u64 offset) -> u64 { return (offset + 15ull) & ~15ull; };
+    SceneCacheHeader header = {
+        .magic = SCENE_CACHE_MAGIC,
+        .version = SCENE_CACHE_VERSION,
+        .source_hash = source_hash,
+    };
+    header.objects = {align_up(sizeof(SceneCacheHeader)), objects.size()};
+    header.object_meshes = {align_up(header.objects.offset + objects.size() * sizeof(CachedObject)), object_meshes.size()};
+    header.meshes = {align_up(header.object_meshes.offset + object_meshes.size() * sizeof(u32)), meshes.size()};
+    header.vertices = {align_up(header.meshes.offset + meshes.size() * sizeof(CachedMesh)), vertex_count};
+    header.indices = {align_up(header.vertices.offset + vertex_count * sizeof(Vertex)), index_count};
+    header.lights = {align_up(header.indices.offset + index_count * sizeof(u32)), scene.scene_lights.size()};
+    header.optimization_stats = scene.optimization_stats;
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), error);
+
+    // write into a temporary file first so that an interrupted write never leaves a corrupt cache behind
+    std::string tmp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if(!out.is_open())
+        {
+            DEBUG_OUT("[SceneCache::store()] Failed to open " << tmp_path);
+            return;
+        }
+
+        auto write_at = [&](u64 offset, const void * data, usize size)
+        {
+            static const char padding[16] = {};
+            u64 current = static_cast<u64>(out.tellp());
+            out.write(padding, static_cast<std::streamsize>(offset - current));
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        };
+
+        write_at(0, &header, sizeof(SceneCacheHeader));
+        write_at(header.objects.offset, objects.data(), objects.size() * sizeof(CachedObject));
+        write_at(header.object_meshes.offset, object_meshes.data(), object_meshes.size() * sizeof(u32));
+        write_at(header.meshes.offset, meshes.data(), meshes.size() * sizeof(CachedMesh));
+        write_at(header.vertices.offset, nullptr, 0);
+        for(const auto & mesh : scene.meshes)
+        {
+            out.write(reinterpret_cast<const char *>(mesh.vertices.data()),
+                      static_cast<std::streamsize>(mesh.vertices.size() * sizeof(Vertex)));
+        }
+        write_at(header.indices.offset, nullptr, 0);
+        for(const auto & mesh : scene.meshes)
+        {
+            out.write(reinterpret_cast<const char *>(mesh.indices.data()),
+                      static_cast<std::streamsize>(mesh.indices.size() * sizeof(u32)));
+            for(const auto & lod : mesh.lods)
+            {
+                out.write(reinterpret_cast<const char *>(lod.indices.data()),
+                          static_cast<std::streamsize>(lod.indices.size() * sizeof(u32)));
+            }
+        }
+        write_at(header.lights.offset, scene.scene_lights.data(), scene.scene_lights.size() * sizeof(SceneLight));
+
+        if(!out.good())
+        {
+            DEBUG_OUT("[SceneCache::store()] Failed to write " << tmp_path);
+            out.close();
+            std::filesystem::remove(tmp_path, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, cache_path, error);
+    if(error) { DEBUG_OUT("[SceneCache::store()] Failed to move cache into place " << error.message()); }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+
+#include "types.hpp"
+#include "utils.hpp"
+#include "scene.hpp"
+
+// Read only memory mapping of a whole file
+struct MappedFile
+{
+    explicit MappedFile(const std::string & path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] auto is_valid() const -> bool { return mapped_data != nullptr; }
+    [[nodiscard]] auto data() const -> const u8 * { return mapped_data; }
+    [[nodiscard]] auto size() const -> usize { return mapped_size; }
+
+    private:
+        const u8 * mapped_data = nullptr;
+        usize mapped_size = 0;
+#if defined(_WIN32)
+        void * file_handle = nullptr;
+        void * mapping_handle = nullptr;
+#endif
+};
+
+// Bump whenever the layout of any of the structs below or the import processing changes
+const u32 SCENE_CACHE_MAGIC = 0x43534154u; // "TASC"
+const u32 SCENE_CACHE_VERSION = 6u;
+
+struct SceneCacheSection
+{
+    u64 offset;
+    u64 count;
+};
+
+struct SceneCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 source_hash;
+    SceneCacheSection objects;
+    SceneCacheSection object_meshes;
+    SceneCacheSection meshes;
+    SceneCacheSection vertices;
+    SceneCacheSection indices;
+    SceneCacheSection lights;
+    // the import-time statistics can not be recomputed from the optimized geometry
+    SceneOptimizationStats optimization_stats;
+};
+
+// Meshes of an object are the object_meshes range [first_mesh, first_mesh + mesh_count), each entry indexes meshes
+struct CachedObject
+{
+    f32mat4x4 transform;
+    u32 first_mesh;
+    u32 mesh_count;
+};
+
+// Indices of all levels of detail of a mesh are stored back to back starting with the full detail one
+struct CachedMesh
+{
+    u32 first_vertex;
+    u32 vertex_count;
+    u32 first_index;
+    u32 lod_count;
+    u32 lod_index_counts[MAX_MESH_LODS];
+    f32 lod_errors[MAX_MESH_LODS];
+};
+
+// Scene geometry already packed in the layout of the renderer GPU buffers. Spans point directly
+// into the memory mapped cache file which stays alive for as long as the SceneCache does.
+struct SceneCache
+{
+    std::span<const CachedObject> objects;
+    std::span<const u32> object_meshes;
+    std::span<const CachedMesh> meshes;
+    std::span<const Vertex> vertices;
+    std::span<const u32> indices;
+    std::span<const SceneLight> lights;
+    SceneOptimizationStats optimization_stats;
+
+    explicit SceneCache(const std::string & cache_path);
+
+    // returns nullptr when the cache file does not exist, is outdated or was created from different source
+    [[nodiscard]] static auto load(const std::string & cache_path, u64 source_hash) -> std::shared_ptr<const SceneCache>;
+    static void store(const std::string & cache_path, u64 source_hash, const Scene & scene);
+
+    private:
+        MappedFile file;
+        SceneCacheHeader header;
+};
+
+[[nodiscard]] auto hash_file_contents(const std::string & path) -> u64;
+[[nodiscard]] auto get_scene_cache_path(u64 source_hash) -> std::string;
@@ -1,8 +1,32 @@
 #pragma once
 
+#include <cstring>
+
 #include "types.hpp"
 #include <daxa/types.hpp>
 
+const u64 FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const u64 FNV_PRIME = 0x100000001b3ull;
+
+// 64 bit FNV-1a variant consuming 8 bytes per step so hashing keeps up with the disk read,
+// passing the hash of previous data as the seed chains several inputs into one hash
+inline auto hash_bytes(const u8 * data, usize size, u64 hash = FNV_OFFSET_BASIS) -> u64
+{
+    usize word_count = size / sizeof(u64);
+    for(usize word_idx = 0; word_idx < word_count; word_idx++)
+    {
+        u64 word;
+        memcpy(&word, data + word_idx * sizeof(u64), sizeof(u64));
+        hash = (hash ^ word) * FNV_PRIME;
+        hash ^= hash >> 32;
+    }
+    for(usize byte_idx = word_count * sizeof(u64); byte_idx < size; byte_idx++)
+    {
+        hash = (hash ^ data[byte_idx]) * FNV_PRIME;
+    }
+    return hash;
+}
+
 inline auto daxa_vec3_from_glm(const f32vec3 & vec) -> daxa::f32vec3 
 {
     return {vec.x, vec.y, vec.z};